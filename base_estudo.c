@@ -8,13 +8,67 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <linux/limits.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include "fileio.h"
+#include "parser.h"
+#include "textscan.h"
+#include "trace.h"
+#include "script.h"
+
+// build: gcc -o base_estudo base_estudo.c fileio.c parser.c textscan.c trace.c script.c
 
 #define MAX_LINE 1024
-#define MAX_ARGS 128
 #define MAX_PATHS 64
+#define MAX_WORKERS 256
+#define TIMEOUT_KILL_AFTER_MS 5000 // SIGTERM -> SIGKILL grace when --kill-after is not given
+#define TIMEOUT_STATUS 124         // exit status of a timed out command, as in coreutils
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// one script of a --batch run
+struct batch_job {
+    char *path;
+    off_t size;
+    int status;
+    double secs;
+};
+
+// a running worker; out_fd is the read end of its output pipe in merged mode
+struct worker {
+    pid_t pid;
+    int job;
+    int out_fd;
+    struct timespec start;
+    char partial[MAX_LINE]; // unfinished output line waiting for its prefix
+    size_t partial_len;
+};
 
 char *paths[MAX_PATHS];
 int path_count = 0;
+int last_status = 0; // exit status of the last external command
+
+// "timeout default ..." for the session and the limit of the command being run;
+// term_ms 0 means no limit
+long default_term_ms = 0, default_kill_ms = TIMEOUT_KILL_AFTER_MS;
+long cur_term_ms = 0, cur_kill_ms = TIMEOUT_KILL_AFTER_MS;
+
+// file engine shared by the builtins, created on first use
+struct fio io;
+int io_ready = 0;
+
+struct fio *get_io() {
+    if (!io_ready) {
+        if (fio_init(&io) < 0) return NULL;
+        io_ready = 1;
+    }
+    return &io;
+}
 
 void init_paths() {
     // default path /bin
@@ -27,18 +81,6 @@ void print_error() {
     write(STDERR_FILENO, msg, strlen(msg));
 }
 
-// tokenize a line into args, return argc
-int parse_args(char *line, char **args) {
-    int argc = 0;
-    char *token = strtok(line, " \t\n");
-    while (token != NULL && argc < MAX_ARGS-1) {
-        args[argc++] = token;
-        token = strtok(NULL, " \t\n");
-    }
-    args[argc] = NULL;
-    return argc;
-}
-
 // resolve external command via paths
 char *resolve_cmd(char *cmd) {
     for (int i = 0; i < path_count; i++) {
@@ -87,12 +129,13 @@ int builtin_path(char **args) {
 }
 
 int builtin_cat(char **args) {
-    if (!args[1] || args[2]) { print_error(); return 1; }
-    FILE *f = fopen(args[1], "r");
-    if (!f) { print_error(); return 1; }
-    char ch;
-    while ((ch = fgetc(f)) != EOF) putchar(ch);
-    fclose(f);
+    if (!args[1]) { print_error(); return 1; }
+    struct fio *e = get_io();
+    if (!e) { print_error(); return 1; }
+    int count = 0;
+    while (args[count + 1]) count++;
+    fflush(stdout);
+    if (fio_cat(e, args + 1, count, STDOUT_FILENO) < 0) print_error();
     return 1;
 }
 
@@ -107,29 +150,69 @@ int builtin_ls(char **args) {
     DIR *d = opendir(".");
     if (!d) { print_error(); return 1; }
     struct dirent *entry;
+    // names are collected so -l can stat them in batches
+    char **names = NULL;
+    int count = 0, cap = 0;
     while ((entry = readdir(d))) {
         if (!show_all && entry->d_name[0] == '.') continue;
         if (!long_fmt) {
             printf("%s  ", entry->d_name);
-        } else {
-            struct stat st;
-            if (stat(entry->d_name, &st) == 0) {
-                printf((S_ISDIR(st.st_mode)) ? "d" : "-");
-                printf((st.st_mode & S_IRUSR) ? "r" : "-");
-                printf((st.st_mode & S_IWUSR) ? "w" : "-");
-                printf((st.st_mode & S_IXUSR) ? "x" : "-");
-                printf(" %ld %s\n", st.st_size, entry->d_name);
-            }
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **grown = realloc(names, cap * sizeof(char *));
+            if (!grown) { print_error(); break; }
+            names = grown;
         }
+        names[count++] = strdup(entry->d_name);
     }
-    if (!long_fmt) printf("\n");
     closedir(d);
+    if (!long_fmt) { printf("\n"); return 1; }
+
+    struct stat *st = malloc((count ? count : 1) * sizeof(struct stat));
+    int *ok = malloc((count ? count : 1) * sizeof(int));
+    struct fio *e = get_io();
+    if (st && ok && e && fio_stat_many(e, names, count, st, ok) == 0) {
+        for (int i = 0; i < count; i++) {
+            if (!ok[i]) continue;
+            printf((S_ISDIR(st[i].st_mode)) ? "d" : "-");
+            printf((st[i].st_mode & S_IRUSR) ? "r" : "-");
+            printf((st[i].st_mode & S_IWUSR) ? "w" : "-");
+            printf((st[i].st_mode & S_IXUSR) ? "x" : "-");
+            printf(" %ld %s\n", st[i].st_size, names[i]);
+        }
+    } else {
+        print_error();
+    }
+    for (int i = 0; i < count; i++) free(names[i]);
+    free(names);
+    free(st);
+    free(ok);
     return 1;
 }
 
+// grep/wc/head run in-process only in the forms textscan reproduces exactly
+// (stdin, no files, no redirection); anything else goes to the external tool
+int is_text_tool(char **args) {
+    if (strcmp(args[0], "grep") && strcmp(args[0], "wc") && strcmp(args[0], "head")) return 0;
+    for (int i = 1; args[i]; i++)
+        if (!strcmp(args[i], "<") || !strcmp(args[i], ">") || !strcmp(args[i], ">>")) return 0;
+    return ts_handles(args);
+}
+
+int run_text_tool(char **args) {
+    fflush(stdout);
+    last_status = ts_run(args, STDIN_FILENO, STDOUT_FILENO);
+    return 1;
+}
+
+int builtin_timeout(char **args);
+
 int is_builtin(char *cmd) {
     return (!strcmp(cmd, "exit") || !strcmp(cmd, "cd") || !strcmp(cmd, "pwd")
-        || !strcmp(cmd, "path") || !strcmp(cmd, "cat") || !strcmp(cmd, "ls"));
+        || !strcmp(cmd, "path") || !strcmp(cmd, "cat") || !strcmp(cmd, "ls")
+        || !strcmp(cmd, "timeout"));
 }
 
 int run_builtin(char **args) {
@@ -139,38 +222,223 @@ int run_builtin(char **args) {
     if (strcmp(args[0], "path") == 0) return builtin_path(args);
     if (strcmp(args[0], "cat") == 0) return builtin_cat(args);
     if (strcmp(args[0], "ls") == 0) return builtin_ls(args);
+    if (strcmp(args[0], "timeout") == 0) return builtin_timeout(args);
     return 0;
 }
 
+// tee-like redirection: the command writes into a pipe and this process
+// duplicates it to every target with tee/splice, then exits with the
+// command's status; append[t] marks the ">>" targets
+void redirect_fanout(char **targets, int *append, int ntargets) {
+    struct fio cio; // the parent's ring must not be shared across fork
+    int fds[FIO_MAX_TARGETS];
+    int p[2];
+    if (fio_init(&cio) < 0) { print_error(); exit(1); }
+    // fio_open_many takes one set of flags, so ">" and ">>" are opened apart
+    for (int pass = 0; pass < 2; pass++) {
+        char *group[FIO_MAX_TARGETS];
+        int where[FIO_MAX_TARGETS], gfds[FIO_MAX_TARGETS], n = 0;
+        for (int t = 0; t < ntargets; t++)
+            if (append[t] == pass) { group[n] = targets[t]; where[n++] = t; }
+        int flags = O_WRONLY | O_CREAT | (pass ? O_APPEND : O_TRUNC);
+        if (n > 0 && fio_open_many(&cio, group, n, flags, 0644, gfds) != n) { print_error(); exit(1); }
+        for (int i = 0; i < n; i++) fds[where[i]] = gfds[i];
+    }
+    if (pipe(p) < 0) { print_error(); exit(1); }
+    TRACE('i', "pipe", targets[0], "rd", p[0], "wr", p[1]);
+    pid_t pid = fork();
+    if (pid < 0) { print_error(); exit(1); }
+    if (pid == 0) {
+        trace_child();
+        fio_exit(&cio);
+        for (int t = 0; t < ntargets; t++) close(fds[t]);
+        close(p[0]);
+        dup2(p[1], STDOUT_FILENO);
+        close(p[1]);
+        return; // go on to exec the command
+    }
+    close(p[1]);
+    signal(SIGPIPE, SIG_IGN); // a target that goes away is dropped, the rest go on
+    int ret = fio_splice_fanout(&cio, p[0], fds, ntargets);
+    close(p[0]);
+    for (int t = 0; t < ntargets; t++) close(fds[t]);
+    fio_exit(&cio);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (ret < 0) print_error();
+    // _exit: exit() would fclose the script FILE shared with the shell and
+    // seek its fd back, making the shell read the same lines again
+    if (trace_enabled) trace_flush();
+    _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
+
+// wait for pid, which leads its own process group, enforcing cur_term_ms:
+// the pidfd is polled with the deadline as timeout, so the wait costs no CPU.
+// On expiry the group gets SIGTERM, then SIGKILL cur_kill_ms later.
+int wait_timed(pid_t pid, const char *name, int *status) {
+    int pfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    int phase = 0;
+    if (pfd >= 0) {
+        struct pollfd p = { pfd, POLLIN, 0 };
+        long wait_ms = cur_term_ms;
+        while (phase < 2) {
+            int r = poll(&p, 1, wait_ms > 0 ? (int)wait_ms : -1);
+            if (r < 0 && errno == EINTR) continue;
+            if (r != 0) break; // exited (or poll failed: fall back to waitpid)
+            if (phase == 0) {
+                fprintf(stderr, "timeout: %s (pid %d) exceeded %.3gs, sending SIGTERM\n",
+                        name, pid, cur_term_ms / 1000.0);
+                TRACE('i', "timeout", name, "pid", pid, "signal", SIGTERM);
+                killpg(pid, SIGTERM);
+                killpg(pid, SIGCONT); // a stopped group would never see the SIGTERM
+                phase = 1;
+                wait_ms = cur_kill_ms;
+                if (wait_ms == 0) break;
+            } else {
+                fprintf(stderr, "timeout: %s (pid %d) ignored SIGTERM, sending SIGKILL\n", name, pid);
+                TRACE('i', "timeout", name, "pid", pid, "signal", SIGKILL);
+                killpg(pid, SIGKILL);
+                phase = 2;
+            }
+        }
+        close(pfd);
+    }
+    while (waitpid(pid, status, 0) < 0 && errno == EINTR)
+        ;
+    if (phase == 2) return 128 + SIGKILL;
+    if (phase == 1) return TIMEOUT_STATUS;
+    return WIFEXITED(*status) ? WEXITSTATUS(*status) : 128 + WTERMSIG(*status);
+}
+
 // execute a simple command with possible redirection
 void exec_simple(char **args) {
+    TRACE('B', "fork", args[0], NULL, 0, NULL, 0);
     pid_t pid = fork();
     if (pid == 0) {
         // child
+        trace_child();
+        // a timed command gets its own group so the signals reach its children too
+        if (cur_term_ms > 0) setpgid(0, 0);
         int fd;
-        // handle output redirection
+        // handle output redirection: "> a", ">> a" or several targets "> a >> b ..."
+        // and input redirection "< a", which is opened straight onto stdin
+        char *targets[FIO_MAX_TARGETS];
+        int append[FIO_MAX_TARGETS];
+        int ntargets = 0, k = 0;
         for (int i = 0; args[i]; i++) {
-            if (strcmp(args[i], ">") == 0) {
-                if (!args[i+1] || args[i+2]) { print_error(); exit(1); }
-                fd = open(args[i+1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (strcmp(args[i], "<") == 0) {
+                if (!args[i+1]) { print_error(); exit(1); }
+                fd = open(args[++i], O_RDONLY);
                 if (fd < 0) { print_error(); exit(1); }
-                dup2(fd, STDOUT_FILENO);
-                args[i] = NULL;
+                dup2(fd, STDIN_FILENO);
+                close(fd);
+                continue;
             }
+            int plain = strcmp(args[i], ">") == 0;
+            if (!plain && strcmp(args[i], ">>") != 0) { args[k++] = args[i]; continue; }
+            if (!args[i+1] || ntargets == FIO_MAX_TARGETS) { print_error(); exit(1); }
+            append[ntargets] = !plain;
+            targets[ntargets++] = args[++i];
+        }
+        args[k] = NULL;
+        if (ntargets == 1) {
+            fd = open(targets[0], O_WRONLY | O_CREAT | (append[0] ? O_APPEND : O_TRUNC), 0644);
+            if (fd < 0) { print_error(); exit(1); }
+            dup2(fd, STDOUT_FILENO);
+        } else if (ntargets > 1) {
+            redirect_fanout(targets, append, ntargets);
         }
         // external?
         char *cmd_path = resolve_cmd(args[0]);
-        if (!cmd_path) { print_error(); exit(1); }
+        if (!cmd_path) {
+            TRACE('i', "exec_error", args[0], "errno", ENOENT, NULL, 0);
+            print_error();
+            exit(1);
+        }
         execv(cmd_path, args);
+        TRACE('i', "exec_error", args[0], "errno", errno, NULL, 0);
         print_error();
         exit(1);
     } else if (pid > 0) {
-        waitpid(pid, NULL, 0);
+        int status = 0;
+        TRACE('E', "fork", args[0], "pid", pid, NULL, 0);
+        TRACE('B', "wait", args[0], "pid", pid, NULL, 0);
+        if (cur_term_ms > 0) {
+            setpgid(pid, pid); // also here, so the group exists before any killpg
+            last_status = wait_timed(pid, args[0], &status);
+        } else {
+            waitpid(pid, &status, 0);
+            last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+        TRACE('E', "wait", args[0], "pid", pid, "status", status);
     } else {
+        TRACE('E', "fork", args[0], "errno", errno, NULL, 0);
         print_error();
     }
 }
 
+// "1.5", "30s", "2m", "1h", "1d" in milliseconds, -1 if invalid
+long parse_duration(const char *s) {
+    char *end;
+    double value = strtod(s, &end);
+    if (end == s || value < 0) return -1;
+    double scale = 1000.0;
+    if (*end == 'm') scale = 60 * 1000.0;
+    else if (*end == 'h') scale = 3600 * 1000.0;
+    else if (*end == 'd') scale = 86400 * 1000.0;
+    else if (*end != 's' && *end != '\0') return -1;
+    if (*end != '\0' && end[1] != '\0') return -1;
+    long ms = (long)(value * scale + 0.5);
+    return value > 0 && ms == 0 ? 1 : ms;
+}
+
+// reads "DUR [--kill-after D]" starting at args[i]; returns the index of the
+// first argument after the options, -1 if something is invalid
+int parse_timeout(char **args, int i, long *term_ms, long *kill_ms) {
+    if (!args[i] || (*term_ms = parse_duration(args[i])) < 0) return -1;
+    *kill_ms = TIMEOUT_KILL_AFTER_MS;
+    i++;
+    if (args[i] && strcmp(args[i], "--kill-after") == 0) {
+        if (!args[i+1] || (*kill_ms = parse_duration(args[i+1])) < 0) return -1;
+        i += 2;
+    } else if (args[i] && strncmp(args[i], "--kill-after=", 13) == 0) {
+        if ((*kill_ms = parse_duration(args[i] + 13)) < 0) return -1;
+        i++;
+    }
+    return i;
+}
+
+// timeout                                  show the session default
+// timeout default off|DUR [--kill-after D] set it for the following commands
+// timeout DUR [--kill-after D] cmd ...     run one external command with a limit
+int builtin_timeout(char **args) {
+    long term_ms, kill_ms;
+    if (!args[1]) {
+        if (default_term_ms == 0) printf("timeout: off\n");
+        else printf("timeout: %.3gs, SIGKILL %.3gs later\n", default_term_ms / 1000.0, default_kill_ms / 1000.0);
+        return 1;
+    }
+    if (strcmp(args[1], "default") == 0) {
+        if (args[2] && strcmp(args[2], "off") == 0 && !args[3]) {
+            default_term_ms = 0;
+            return 1;
+        }
+        int next = parse_timeout(args, 2, &term_ms, &kill_ms);
+        if (next < 0 || args[next]) { print_error(); return 1; }
+        default_term_ms = term_ms;
+        default_kill_ms = kill_ms;
+        return 1;
+    }
+    int next = parse_timeout(args, 1, &term_ms, &kill_ms);
+    if (next < 0 || !args[next] || is_builtin(args[next])) { print_error(); return 1; }
+    cur_term_ms = term_ms;
+    cur_kill_ms = kill_ms;
+    exec_simple(args + next);
+    cur_term_ms = default_term_ms;
+    cur_kill_ms = default_kill_ms;
+    return 1;
+}
+
 // parse and handle pipes and parallel
 void eval_line(char *line) {
     // split parallel by '&'
@@ -180,35 +448,294 @@ void eval_line(char *line) {
         // TODO: handle pipes: left as exercise
         // for now only simple commands
         char *parts = strdup(cmd);
-        char *args[MAX_ARGS];
+        char *args[PARSE_MAX_ARGS];
         int argc = parse_args(parts, args);
         if (argc == 0) { free(parts); cmd = strtok_r(NULL, "&", &saveptr1); continue; }
+        cur_term_ms = default_term_ms;
+        cur_kill_ms = default_kill_ms;
         if (is_builtin(args[0])) run_builtin(args);
+        else if (is_text_tool(args)) run_text_tool(args);
         else exec_simple(args);
         free(parts);
         cmd = strtok_r(NULL, "&", &saveptr1);
     }
 }
 
-int main(int argc, char *argv[]) {
-    init_paths();
-    FILE *input = stdin;
-    if (argc == 2) {
-        input = fopen(argv[1], "r");
-        if (!input) { print_error(); exit(1); }
-    } else if (argc > 2) {
-        print_error(); exit(1);
+// ScriptOps.run: one simple command of a script; pipes are not supported
+// here and "&" runs in order like in eval_line
+int script_command(char **words, bool background, void *ctx) {
+    (void)background;
+    (void)ctx;
+    for (int i = 0; words[i]; i++)
+        if (strcmp(words[i], "|") == 0) { print_error(); return 1; }
+    cur_term_ms = default_term_ms;
+    cur_kill_ms = default_kill_ms;
+    if (is_builtin(words[0])) {
+        last_status = 0;
+        run_builtin(words);
+        return last_status;
     }
+    if (is_text_tool(words)) {
+        run_text_tool(words);
+        return last_status;
+    }
+    exec_simple(words);
+    return last_status;
+}
+
+// if/while/until/for, ';', '&&', '||' and variables go through the script
+// interpreter; lines are read until every construct is closed
+void run_script(char *line, FILE *input) {
+    char script[MAX_LINE * 16];
+    bool incomplete;
+    ScriptNode *tree;
+    snprintf(script, sizeof(script), "%s", line);
+    while (!(tree = script_compile(script, &incomplete)) && incomplete) {
+        size_t used = strlen(script);
+        if (input == stdin) printf("> ");
+        if (used + 1 >= sizeof(script) || !fgets(script + used, sizeof(script) - used, input)) break;
+    }
+    if (!tree) { last_status = 2; return; }
+    ScriptOps ops = {script_command, NULL, NULL, NULL};
+    last_status = script_run(tree, &ops);
+}
+
+// read and evaluate lines until EOF, prompting only on stdin
+int run_input(FILE *input) {
     char line[MAX_LINE];
     while (1) {
         char cwd[PATH_MAX];
 
         if (getcwd(cwd, sizeof(cwd)) != NULL){
             if (input == stdin) printf("%s sh> ", cwd);
-            if (!fgets(line, sizeof(line), input)) break;
-            eval_line(line);
+            TRACE('B', "read_line", NULL, NULL, 0, NULL, 0);
+            char *got = fgets(line, sizeof(line), input);
+            TRACE('E', "read_line", NULL, "len", got ? strlen(line) : 0, NULL, 0);
+            if (!got) break;
+            if (script_needed(line)) run_script(line, input);
+            else eval_line(line);
+        }
+    }
+    return last_status;
+}
+
+double seconds_since(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// largest scripts first, so a long one doesn't start last and stretch the tail
+int by_size_desc(const void *a, const void *b) {
+    const struct batch_job *x = a, *y = b;
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+// add a script, or every regular file of a directory, to the job list
+int add_batch_path(const char *path, struct batch_job **jobs, int *count, int *cap) {
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+    if (S_ISDIR(st.st_mode)) {
+        DIR *d = opendir(path);
+        if (!d) return -1;
+        struct dirent *entry;
+        while ((entry = readdir(d))) {
+            if (entry->d_name[0] == '.') continue;
+            char full[PATH_MAX];
+            snprintf(full, sizeof(full), "%s/%s", path, entry->d_name);
+            struct stat fst;
+            if (stat(full, &fst) == 0 && S_ISREG(fst.st_mode) && add_batch_path(full, jobs, count, cap) < 0) {
+                closedir(d);
+                return -1;
+            }
+        }
+        closedir(d);
+        return 0;
+    }
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        struct batch_job *grown = realloc(*jobs, *cap * sizeof(struct batch_job));
+        if (!grown) return -1;
+        *jobs = grown;
+    }
+    (*jobs)[*count].path = strdup(path);
+    (*jobs)[*count].size = st.st_size;
+    (*jobs)[*count].status = -1;
+    (*jobs)[*count].secs = 0;
+    (*count)++;
+    return 0;
+}
+
+// fork a worker that runs one script with stdout/stderr sent to out_fd
+pid_t start_worker(const char *script, int out_fd, int close_fd) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) {
+        TRACE('i', "worker", script, "pid", pid, "out", out_fd);
+        return pid;
+    }
+    trace_child();
+    if (close_fd >= 0) close(close_fd);
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(out_fd, STDERR_FILENO);
+    if (out_fd > STDERR_FILENO) close(out_fd);
+    FILE *f = fopen(script, "r");
+    if (!f) { print_error(); exit(1); }
+    int status = run_input(f);
+    fclose(f);
+    fflush(stdout);
+    exit(status);
+}
+
+// write the complete lines in buf to stdout, each prefixed with the script name
+void emit_prefixed(struct worker *w, const char *name, const char *buf, size_t len, int flush_partial) {
+    for (size_t i = 0; i < len; i++) {
+        if (w->partial_len < sizeof(w->partial) - 1) w->partial[w->partial_len++] = buf[i];
+        if (buf[i] == '\n' || w->partial_len == sizeof(w->partial) - 1) {
+            printf("[%s] %.*s", name, (int)w->partial_len, w->partial);
+            if (buf[i] != '\n') printf("\n");
+            w->partial_len = 0;
+        }
+    }
+    if (flush_partial && w->partial_len > 0) {
+        printf("[%s] %.*s\n", name, (int)w->partial_len, w->partial);
+        w->partial_len = 0;
+    }
+}
+
+// shell --batch [-j N] [-o DIR] script... | dir
+int run_batch(int argc, char *argv[]) {
+    int workers = 4;
+    char *out_dir = NULL;
+    struct batch_job *jobs = NULL;
+    int count = 0, cap = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+            if (workers < 1 || workers > MAX_WORKERS) { print_error(); return 1; }
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (add_batch_path(argv[i], &jobs, &count, &cap) < 0) {
+            print_error();
+            return 1;
+        }
+    }
+    if (count == 0) { print_error(); return 1; }
+    qsort(jobs, count, sizeof(struct batch_job), by_size_desc);
+
+    struct worker *pool = calloc(workers, sizeof(struct worker));
+    if (!pool) { print_error(); return 1; }
+    for (int w = 0; w < workers; w++) pool[w].pid = 0;
+
+    int next = 0, active = 0, failed = 0;
+    struct timespec batch_start;
+    clock_gettime(CLOCK_MONOTONIC, &batch_start);
+
+    while (next < count || active > 0) {
+        // a free slot takes the next script right away
+        for (int w = 0; w < workers && next < count; w++) {
+            if (pool[w].pid != 0) continue;
+            int out_fd, read_fd = -1;
+            if (out_dir) {
+                char out_path[PATH_MAX];
+                const char *base = strrchr(jobs[next].path, '/');
+                snprintf(out_path, sizeof(out_path), "%s/%s.out", out_dir, base ? base + 1 : jobs[next].path);
+                out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            } else {
+                int p[2];
+                if (pipe(p) < 0) { out_fd = -1; }
+                else { read_fd = p[0]; out_fd = p[1]; }
+            }
+            if (out_fd < 0) { print_error(); jobs[next++].status = 1; failed++; continue; }
+
+            clock_gettime(CLOCK_MONOTONIC, &pool[w].start);
+            pool[w].pid = start_worker(jobs[next].path, out_fd, read_fd);
+            close(out_fd);
+            if (pool[w].pid < 0) {
+                print_error();
+                if (read_fd >= 0) close(read_fd);
+                pool[w].pid = 0;
+                jobs[next++].status = 1;
+                failed++;
+                continue;
+            }
+            pool[w].job = next++;
+            pool[w].out_fd = read_fd;
+            pool[w].partial_len = 0;
+            active++;
+        }
+
+        pid_t done;
+        int status = 0;
+        if (out_dir) {
+            done = waitpid(-1, &status, 0);
+            if (done < 0) { if (errno == EINTR) continue; break; }
+        } else {
+            // merged mode: forward output as it comes, a worker is done at EOF
+            struct pollfd fds[MAX_WORKERS];
+            int slot[MAX_WORKERS], n = 0;
+            for (int w = 0; w < workers; w++) {
+                if (pool[w].pid == 0) continue;
+                fds[n].fd = pool[w].out_fd;
+                fds[n].events = POLLIN;
+                slot[n++] = w;
+            }
+            if (poll(fds, n, -1) < 0) { if (errno == EINTR) continue; break; }
+            done = 0;
+            for (int i = 0; i < n && done == 0; i++) {
+                if (!fds[i].revents) continue;
+                struct worker *wk = &pool[slot[i]];
+                const char *name = jobs[wk->job].path;
+                char buf[FIO_BUF_SIZE];
+                ssize_t r = read(wk->out_fd, buf, sizeof(buf));
+                if (r > 0) { emit_prefixed(wk, name, buf, r, 0); continue; }
+                if (r < 0 && errno == EINTR) continue;
+                emit_prefixed(wk, name, NULL, 0, 1);
+                close(wk->out_fd);
+                done = waitpid(wk->pid, &status, 0);
+            }
+            if (done <= 0) continue;
         }
+
+        for (int w = 0; w < workers; w++) {
+            if (pool[w].pid != done) continue;
+            struct batch_job *job = &jobs[pool[w].job];
+            job->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            job->secs = seconds_since(&pool[w].start);
+            if (job->status != 0) failed++;
+            pool[w].pid = 0;
+            active--;
+            break;
+        }
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "\n%-40s %6s %10s\n", "script", "status", "seconds");
+    for (int i = 0; i < count; i++) {
+        fprintf(stderr, "%-40s %6d %10.3f\n", jobs[i].path, jobs[i].status, jobs[i].secs);
+        free(jobs[i].path);
+    }
+    fprintf(stderr, "%d scripts, %d failed, %d workers, %.3fs total\n",
+            count, failed, workers, seconds_since(&batch_start));
+    free(jobs);
+    free(pool);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    trace_from_env();
+    init_paths();
+    if (argc >= 2 && strcmp(argv[1], "--batch") == 0)
+        return run_batch(argc - 2, argv + 2);
+    FILE *input = stdin;
+    if (argc == 2) {
+        input = fopen(argv[1], "r");
+        if (!input) { print_error(); exit(1); }
+    } else if (argc > 2) {
+        print_error(); exit(1);
     }
+    run_input(input);
     if (input != stdin) fclose(input);
     return 0;
 }
\ No newline at end of file
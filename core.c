@@ -0,0 +1,2588 @@
+#define _GNU_SOURCE
+#include "shell.h"
+
+// nucleo da shell: execucao de pipelines, jobs e loop de eventos, builtins,
+// substituicao de comandos e posicionamento nas cpus. Usado pelo shell.c e
+// pela libshell.
+
+static Topology topo;
+Placement session_place = {PLACE_NONE};
+Placement *current_place = &session_place; // politica da pipeline atual
+static cpu_set_t stage_cpus; // mascara aplicada ao proximo launch_process
+static bool stage_pinned = false;
+static int place_base = 0;   // rotaciona os cores usados entre pipelines
+static int spread_node = 0;  // no NUMA da proxima pipeline em PLACE_SPREAD
+
+ExecEnv *exec_env = NULL; // NULL: filhos herdam tudo da shell
+
+static Job jobs[MAX_JOBS];
+static int epfd = -1;       // loop de eventos: stdin, signalfd e pidfds
+static int sigfd = -1;
+static sigset_t orig_mask;  // mascara restaurada nos filhos antes do exec
+static bool stdin_polled = true; // false quando stdin e arquivo comum (epoll nao aceita)
+static bool stdin_ready = false;
+static bool stdin_eof = false;
+static bool interrupted = false; // SIGINT recebido com a shell esperando entrada
+static bool interrupt_pending = false; // ctrl-c ainda nao visto pelos lacos dos scripts
+static bool watch_ready = false; // o inotify do watch tem eventos para ler
+static char inbuf[MAX_LINE * 4];
+static size_t inlen = 0;
+bool measure_session = false; // "measure on": todas as pipelines medidas
+bool measure_line = false; // "measure -- ...": so a pipeline atual
+bool tail_inline = false; // grep/wc/head no fim da pipeline rodam dentro da shell
+TimeoutSpec session_timeout = {0, 0}; // "timeout default ..."
+TimeoutSpec *current_timeout = &session_timeout; // limite da pipeline atual
+static int tfd = -1;             // timerfd armado no proximo prazo de timeout
+static bool group_timed = false; // a pipeline sendo lancada tem timeout e grupo proprio
+static pid_t group_leader = 0;   // pgid dela, o pid do primeiro estagio
+static char **line_allocs = NULL; // saidas de $(...) que os argv da linha apontam
+static int line_alloc_count = 0;
+static int line_alloc_cap = 0;
+static HereDoc heredocs[MAX_HEREDOCS]; // corpos lidos por read_heredocs para a linha atual
+static int heredoc_count = 0;
+static HereBody body; // corpo sendo montado (here-doc ou here-string)
+
+// ! prepara o grupo de processos da proxima pipeline: com timeout ela ganha
+// ! um grupo proprio para que SIGTERM/SIGKILL alcancem tambem os netos
+static void begin_group(void)
+{
+    group_timed = current_timeout->term_ms > 0;
+    group_leader = 0;
+}
+
+// ! tira de args os destinos "> arq" e ">> arq" e abre cada um em fds;
+// ! retorna quantos ou -1 (sem deixar nenhum aberto)
+static int open_stage_outputs(char **args, int *fds)
+{
+    char *files[MAX_OUTPUTS];
+    int append[MAX_OUTPUTS];
+    int count = collect_outputs(args, files, append, MAX_OUTPUTS);
+
+    for (int i = 0; i < count; i++)
+    {
+        fds[i] = open_output(files[i], append[i]);
+        if (fds[i] < 0)
+        {
+            perror(files[i]);
+            while (i-- > 0)
+                close(fds[i]);
+            return -1;
+        }
+    }
+    return count;
+}
+
+// ! write ate o fim, repetindo nas escritas parciais
+static int write_all(int fd, const char *data, size_t n)
+{
+    while (n > 0)
+    {
+        ssize_t w = write(fd, data, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0)
+            return -1;
+        data += w;
+        n -= w;
+    }
+    return 0;
+}
+
+// ! acrescenta n bytes ao corpo; o que passa de HEREDOC_PIPE_MAX vai para um
+// ! memfd, escrito em blocos do tamanho do buffer
+static int body_write(HereBody *b, const char *data, size_t n)
+{
+    while (n > 0)
+    {
+        if (b->len == sizeof(b->buf))
+        {
+            if (b->memfd < 0)
+                b->memfd = memfd_create("heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if (b->memfd < 0 || write_all(b->memfd, b->buf, b->len) < 0)
+                return -1;
+            b->len = 0;
+        }
+        size_t take = sizeof(b->buf) - b->len < n ? sizeof(b->buf) - b->len : n;
+        memcpy(b->buf + b->len, data, take);
+        b->len += take;
+        data += take;
+        n -= take;
+    }
+    return 0;
+}
+
+// ! fd de leitura com o corpo: um pipe ja cheio quando o corpo cabe nele (mais
+// ! barato que criar o memfd), senao o memfd selado e voltado para o inicio
+static int body_finish(HereBody *b)
+{
+    if (b->memfd < 0)
+    {
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) == 0)
+        {
+            if (fcntl(p[1], F_GETPIPE_SZ) >= (int)b->len && write_all(p[1], b->buf, b->len) == 0)
+            {
+                close(p[1]);
+                return p[0];
+            }
+            close(p[0]);
+            close(p[1]);
+        }
+        b->memfd = memfd_create("heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (b->memfd < 0)
+        {
+            perror("memfd_create");
+            return -1;
+        }
+    }
+
+    int fd = b->memfd;
+    b->memfd = -1;
+    if (write_all(fd, b->buf, b->len) < 0 ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0 ||
+        lseek(fd, 0, SEEK_SET) < 0)
+    {
+        perror("here-doc");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// ! le o corpo de um here-doc ate a linha delim; com strip tira os tabs do
+// ! inicio das linhas ("<<-"). Retorna o fd do corpo ou -1
+static int read_heredoc_body(const char *delim, size_t delim_len, bool strip, HeredocReader next, void *ctx)
+{
+    static char chunk[MAX_LINE * 4 + 1]; // cabe o inbuf inteiro: linha longa vem em pedacos
+    bool at_start = true;
+
+    body.len = 0;
+    body.memfd = -1;
+    while (1)
+    {
+        int got = next(chunk, sizeof(chunk), ctx);
+        if (got < 0)
+            break; // ctrl-c descarta a linha toda
+        if (got == 0)
+        {
+            fprintf(stderr, "aviso: here-doc terminado pelo fim da entrada (esperava %.*s)\n", (int)delim_len, delim);
+            return body_finish(&body);
+        }
+
+        char *text = chunk;
+        size_t len = strlen(chunk);
+        if (at_start && strip)
+        {
+            while (*text == '\t')
+                text++;
+            len -= text - chunk;
+        }
+        if (at_start && len >= delim_len && memcmp(text, delim, delim_len) == 0 &&
+            (len == delim_len || (len == delim_len + 1 && text[delim_len] == '\n')))
+            return body_finish(&body);
+
+        at_start = len > 0 && text[len - 1] == '\n';
+        if (body_write(&body, text, len) < 0)
+        {
+            perror("here-doc");
+            break;
+        }
+    }
+    if (body.memfd >= 0)
+        close(body.memfd);
+    body.memfd = -1;
+    return -1;
+}
+
+int read_heredocs(char *line, HeredocReader next, void *ctx)
+{
+    char *p = line;
+
+    while ((p = strstr(p, "<<")) != NULL)
+    {
+        char *start = p;
+        while (*p == '<')
+            p++;
+        // so "<<" no inicio de uma palavra; "<<<" e here-string
+        if (p - start != 2 || (start != line && start[-1] != ' ' && start[-1] != '\t'))
+            continue;
+
+        bool strip = *p == '-';
+        if (strip)
+            p++;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        char *word = p;
+        size_t len = strcspn(word, " \t\n&");
+        if (len == 0)
+            continue; // collect_input reclama da falta do delimitador
+        if (heredoc_count == MAX_HEREDOCS)
+        {
+            fprintf(stderr, "erro: mais de %d here-docs na linha\n", MAX_HEREDOCS);
+            return -1;
+        }
+
+        // aspas no delimitador so sao tiradas: o corpo nunca e expandido
+        const char *delim = word;
+        size_t delim_len = len;
+        if (len >= 2 && (word[0] == '\'' || word[0] == '"') && word[len - 1] == word[0])
+        {
+            delim++;
+            delim_len -= 2;
+        }
+
+        int fd = read_heredoc_body(delim, delim_len, strip, next, ctx);
+        if (fd < 0)
+            return -1;
+        heredocs[heredoc_count].word = word;
+        heredocs[heredoc_count++].fd = fd;
+        p = word + len;
+    }
+    return heredoc_count;
+}
+
+// ! tira de args a entrada do estagio e abre: arquivo de "< arq", corpo ja
+// ! lido de "<<FIM" ou texto de "<<< texto"; retorna o fd, STDIN_FILENO sem
+// ! redirecao ou -1. Qualquer fd serve como stdin (arquivo, fifo, memfd,
+// ! pipe), entao o estagio le direto dele, sem processo intermediario
+static int open_stage_input(char **args)
+{
+    char *word;
+    int fd = -1;
+
+    switch (collect_input(args, &word))
+    {
+    case 0:
+        return STDIN_FILENO;
+    case INPUT_FILE:
+        fd = open_input(word);
+        if (fd < 0)
+            perror(word);
+        return fd;
+    case INPUT_HEREDOC:
+        for (int i = 0; i < heredoc_count; i++)
+        {
+            if (heredocs[i].word == word && heredocs[i].fd >= 0)
+            {
+                fd = heredocs[i].fd;
+                heredocs[i].fd = -1; // cada corpo e lido por um estagio so
+                return fd;
+            }
+        }
+        fprintf(stderr, "erro: here-doc sem corpo (%s)\n", word);
+        return -1;
+    case INPUT_STRING:
+        body.len = 0;
+        body.memfd = -1;
+        if (body_write(&body, word, strlen(word)) < 0 || body_write(&body, "\n", 1) < 0)
+        {
+            perror("here-string");
+            return -1;
+        }
+        return body_finish(&body);
+    }
+    return -1;
+}
+
+// ! saida com varios destinos: um processo le de um pipe e duplica para todos
+// ! com tee/splice, sem passar os dados pelo espaco de usuario; retorna a
+// ! escrita do pipe para o estagio (com um destino so, o proprio fd) e fecha
+// ! os destinos no pai
+static int start_fanout(int *fds, int count, pid_t *pid)
+{
+    int p[2];
+
+    *pid = 0;
+    if (count == 1)
+        return fds[0];
+
+    if (pipe2(p, O_CLOEXEC) == -1)
+    {
+        perror("pipe error");
+        for (int i = 0; i < count; i++)
+            close(fds[i]);
+        return -1;
+    }
+    TRACE('i', "fanout", NULL, "rd", p[0], "targets", count);
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        trace_child();
+        sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+        signal(SIGPIPE, SIG_IGN); // destino que sai vira EPIPE e os outros continuam
+        close(p[1]);
+
+        // sem exec o CLOEXEC nao fecha nada: os destinos vao para 3.., a leitura
+        // logo depois e o resto (pipes dos outros estagios) e fechado
+        int targets[MAX_OUTPUTS + 1];
+        int high[MAX_OUTPUTS + 1];
+        for (int i = 0; i < count; i++)
+            high[i] = fcntl(fds[i], F_DUPFD, 4 + count);
+        high[count] = fcntl(p[0], F_DUPFD, 4 + count);
+        for (int i = 0; i <= count; i++)
+        {
+            targets[i] = 3 + i;
+            if (high[i] < 0 || dup2(high[i], targets[i]) < 0)
+                _exit(EXIT_FAILURE);
+        }
+#ifdef SYS_close_range
+        syscall(SYS_close_range, 4 + count, ~0U, 0);
+#endif
+
+        struct fio io;
+        if (fio_init(&io) < 0)
+            _exit(EXIT_FAILURE);
+        int ret = fio_splice_fanout(&io, targets[count], targets, count);
+        fio_exit(&io);
+        _exit(ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    close(p[0]);
+    for (int i = 0; i < count; i++)
+        close(fds[i]);
+    if (child < 0)
+    {
+        perror("fork error");
+        close(p[1]);
+        return -1;
+    }
+    *pid = child;
+    return p[1];
+}
+
+// ! saida de um builtin com os destinos de args; retorna o fd onde escrever
+// ! (default_fd sem redirecao, -1 em erro) e em *fanout o processo que copia
+// ! para varios destinos, a esperar com waitpid depois de fechar o fd
+int redirect_outputs(char **args, int default_fd, pid_t *fanout)
+{
+    int fds[MAX_OUTPUTS];
+
+    // builtins nao leem a entrada, mas o arquivo tem que existir como no sh
+    int in_fd = open_stage_input(args);
+    if (in_fd < 0)
+        return -1;
+    if (in_fd != STDIN_FILENO)
+        close(in_fd);
+
+    int count = open_stage_outputs(args, fds);
+
+    *fanout = 0;
+    if (count <= 0)
+        return count < 0 ? -1 : default_fd;
+    return start_fanout(fds, count, fanout);
+}
+
+// ! func que executa comando simples, no caso comandos seperados por &;
+// ! retorna o indice do job ou -1 se nada foi lancado
+int execute(char **args)
+{
+    int fds[MAX_OUTPUTS];
+    int out_fd = STDOUT_FILENO;
+    pid_t pids[3];
+    int helpers = 0;
+    pid_t fanout = 0;
+
+    int in_fd = open_stage_input(args);
+    if (in_fd < 0) return -1;
+    int count = open_stage_outputs(args, fds);
+    if (count < 0) // erro de sintaxe ou destino que nao abriu
+    {
+        if (in_fd != STDIN_FILENO) close(in_fd);
+        return -1;
+    }
+
+    begin_group();
+    if (count > 0)
+    {
+        out_fd = start_fanout(fds, count, &fanout);
+        if (out_fd < 0)
+        {
+            if (in_fd != STDIN_FILENO) close(in_fd);
+            return -1;
+        }
+        pids[1 + helpers++] = fanout;
+    }
+    if (in_fd != STDIN_FILENO && (measure_session || measure_line))
+    {
+        pid_t relay = start_input_relay(0, &in_fd);
+        if (relay > 0)
+            pids[1 + helpers++] = relay;
+    }
+
+    select_stage_cpus(0, 1);
+    pid_t pid = launch_process(in_fd, out_fd, args);
+
+    if (in_fd != STDIN_FILENO)
+        close(in_fd);
+    if (out_fd != STDOUT_FILENO)
+    {
+        close(out_fd);
+    }
+    
+    if (pid > 0 )
+    {
+        pids[0] = pid;
+        return job_start(pids, 1 + helpers, 0, true);
+    }
+    // sem leitor/escritor o fan-out e o relay ja receberam EOF/EPIPE
+    for (int i = 1; i <= helpers; i++)
+        waitpid(pids[i], NULL, 0);
+    return -1;
+}
+
+// ! cria e lanca o processo com pipes para comunicacao com outro processo
+pid_t launch_process(int in_fd, int out_fd, char **args)
+{
+    // o cache e consultado no pai para que o que for aprendido fique guardado
+    const char *path = NULL;
+    if (exec_env != NULL && exec_env->cache != NULL)
+        path = path_cache_lookup(exec_env->cache, args[0]);
+
+    TRACE('B', "fork", args[0], "in", in_fd, "out", out_fd);
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        TRACE('E', "fork", args[0], "errno", errno, NULL, 0);
+        perror("fork error");
+        return -1; // Retorna -1 para indicar erro no fork
+    }
+
+    if (pid == 0)
+    { // Processo Filho
+        trace_child();
+        if (group_timed)
+            setpgid(0, group_leader); // 0 no primeiro estagio: vira lider
+        sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+        signal(SIGPIPE, SIG_DFL); // o daemon e hospedeiros da libshell costumam ignorar
+
+        if (stage_pinned && sched_setaffinity(0, sizeof(stage_cpus), &stage_cpus) < 0)
+            perror("sched_setaffinity");
+
+        if (exec_env != NULL)
+        {
+            if (exec_env->cwd != NULL && chdir(exec_env->cwd) < 0)
+            {
+                perror("chdir");
+                exit(EXIT_FAILURE);
+            }
+            if (exec_env->own_env)
+                clearenv();
+            for (int i = 0; exec_env->vars != NULL && exec_env->vars[i] != NULL; i++)
+                putenv(exec_env->vars[i]);
+            if (exec_env->err_fd >= 0 && dup2(exec_env->err_fd, STDERR_FILENO) < 0)
+                exit(EXIT_FAILURE);
+            // o in_fd de um estagio do meio sobrescreve este logo abaixo
+            if (exec_env->in_fd >= 0 && dup2(exec_env->in_fd, STDIN_FILENO) < 0)
+                exit(EXIT_FAILURE);
+        }
+
+        if (in_fd != STDIN_FILENO) // redireciona para entrada padrao
+        {
+            if (dup2(in_fd, STDIN_FILENO) < 0)
+            {
+                perror("dup2 input error");
+                exit(EXIT_FAILURE);
+            }
+            close(in_fd); 
+        }
+
+        // Redireciona a saida padrão se não for STDOUT_FILENO, so sai para padrao se for o ultimo comando
+        if (out_fd != STDOUT_FILENO)
+        {
+            if (dup2(out_fd, STDOUT_FILENO) < 0)
+            {
+                perror("dup2 output error");
+                exit(EXIT_FAILURE);
+            }
+            close(out_fd); // Fecha o descritor original
+        }
+
+        // grep/wc/head simples rodam no proprio filho, sem exec; sem o exec o
+        // CLOEXEC nao fecha os pipes herdados, entao fecha tudo acima do stderr
+        if (ts_handles(args))
+        {
+#ifdef SYS_close_range
+            syscall(SYS_close_range, 3, ~0U, 0);
+#endif
+            _exit(ts_run(args, STDIN_FILENO, STDOUT_FILENO));
+        }
+
+        // Executa o comando e sai caso tenha erro; caminho do cache velho cai no execvp
+        if (path != NULL)
+            execv(path, args);
+        if (execvp(args[0], args) == -1)
+        {
+            TRACE('i', "exec_error", args[0], "errno", errno, NULL, 0);
+            perror("Erro ao executar o comando");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // repetido no pai para o grupo existir antes de qualquer kill
+    if (group_timed)
+    {
+        setpgid(pid, group_leader != 0 ? group_leader : pid);
+        if (group_leader == 0)
+            group_leader = pid;
+    }
+
+    TRACE('E', "fork", args[0], "pid", pid, NULL, 0);
+    return pid; // Processo Pai retorna o PID do filho
+}
+
+// ! executa os comandos juntos chamando launch_process juntamente com pipes
+// ! fecha as entradas e os destinos dos estagios [from, to) que nenhum
+// ! processo recebeu ainda
+static void close_stage_fds(int *ins, int outs[][MAX_OUTPUTS + 1], int *out_count, int from, int to)
+{
+    for (int i = from; i < to; i++)
+    {
+        for (int k = 0; k < out_count[i]; k++)
+            close(outs[i][k]);
+        if (ins[i] != STDIN_FILENO)
+            close(ins[i]);
+    }
+}
+
+// ! desfaz uma pipeline que falhou no meio do lancamento: os estagios e
+// ! auxiliares ja lancados recebem SIGTERM e sao esperados aqui
+static void abort_launch(pid_t *pids, int launched, pid_t *helpers, int helper_count)
+{
+    for (int i = 0; i < launched; i++)
+        if (pids[i] > 0)
+            kill(pids[i], SIGTERM);
+    for (int i = 0; i < helper_count; i++)
+        kill(helpers[i], SIGTERM);
+    for (int i = 0; i < launched; i++)
+        if (pids[i] > 0)
+            waitpid(pids[i], NULL, 0);
+    for (int i = 0; i < helper_count; i++)
+        waitpid(helpers[i], NULL, 0);
+}
+
+int execute_pipeline(char *stages[MAX_STAGES][MAX_ARGS + 1], int stage_count, int out_fd_final)
+{
+    int in_fd = STDIN_FILENO;
+    int fd[2];
+    pid_t pids[MAX_JOB_PROCS]; // estagios seguidos dos relays do modo medido e dos fan-outs
+    int helpers = 0;
+    int outs[MAX_STAGES][MAX_OUTPUTS + 1]; // destinos de cada estagio (+ o pipe seguinte)
+    int out_count[MAX_STAGES] = {0};
+    int ins[MAX_STAGES]; // "< arq" de cada estagio, STDIN_FILENO sem
+    int last_out_fd = out_fd_final;
+    bool measured = measure_session || measure_line;
+    begin_group();
+    // o ultimo estagio le o pipe dentro da shell, sem fork; so na ultima
+    // pipeline da linha, ja que a shell fica ocupada ate ele terminar (e
+    // nunca com timeout, que a shell nao conseguiria aplicar presa no read)
+    bool inline_last = tail_inline && !group_timed && stage_count > 1 && ts_handles(stages[stage_count - 1]);
+    int launched = inline_last ? stage_count - 1 : stage_count;
+
+    // abre entradas e destinos de todos os estagios antes de lancar qualquer
+    // processo; num estagio do meio os destinos recebem uma copia do que segue
+    // pelo pipe e a entrada toma o lugar do pipe do estagio anterior
+    for (int i = 0; i < stage_count; i++)
+    {
+        ins[i] = open_stage_input(stages[i]);
+        out_count[i] = ins[i] < 0 ? -1 : open_stage_outputs(stages[i], outs[i]);
+        if (out_count[i] < 0)
+        {
+            fprintf(stderr, "erro de sintaxa abortando\n");
+            if (ins[i] > STDIN_FILENO) close(ins[i]);
+            close_stage_fds(ins, outs, out_count, 0, i);
+            if (out_fd_final != STDOUT_FILENO) close(out_fd_final);
+            return -1;
+        }
+    }
+
+    if (out_count[stage_count - 1] > 0)
+    {
+        pid_t fanout;
+        if (out_fd_final != STDOUT_FILENO) close(out_fd_final);
+        last_out_fd = start_fanout(outs[stage_count - 1], out_count[stage_count - 1], &fanout);
+        out_count[stage_count - 1] = 0; // o start_fanout ja fechou os destinos
+        if (fanout > 0)
+            pids[MAX_STAGES + helpers++] = fanout;
+        if (last_out_fd < 0)
+        {
+            perror("error ao abrir pipe de saida");
+            close_stage_fds(ins, outs, out_count, 0, stage_count);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < launched; i++)
+    {
+        int out_fd;
+
+        // Se nao for o último comando, cria um pipe para a saida
+        if (i < stage_count - 1)
+        {
+            // os extremos nao podem vazar para os outros estagios: um estagio
+            // com a leitura do proprio pipe aberta nunca recebe SIGPIPE
+            if (pipe2(fd, O_CLOEXEC) == -1)
+            {
+                perror("pipe error");
+                fd[0] = -1;
+                out_fd = -1;
+            }
+            else
+            {
+                TRACE('i', "pipe", stages[i][0], "rd", fd[0], "wr", fd[1]);
+                out_fd = fd[1]; // A saida sera a escrita do pipe
+            }
+
+            if (out_fd >= 0 && out_count[i] > 0)
+            {
+                pid_t fanout;
+                outs[i][out_count[i]++] = fd[1];
+                out_fd = start_fanout(outs[i], out_count[i], &fanout);
+                out_count[i] = 0; // fechados pelo start_fanout, ate em erro
+                if (fanout > 0)
+                    pids[MAX_STAGES + helpers++] = fanout;
+            }
+
+            if (out_fd < 0)
+            {
+                // sem abortar a shell (ou o hospedeiro da libshell e o daemon):
+                // fecha o que sobrou e desfaz os estagios ja lancados
+                if (fd[0] >= 0) close(fd[0]);
+                if (in_fd != STDIN_FILENO) close(in_fd);
+                if (last_out_fd != STDOUT_FILENO) close(last_out_fd);
+                close_stage_fds(ins, outs, out_count, i, stage_count);
+                abort_launch(pids, i, pids + MAX_STAGES, helpers);
+                return -1;
+            }
+        }
+        else // ultimo caso, escreve na saida padrao ou no arquivo
+        {
+            out_fd = last_out_fd;
+        }
+
+        if (ins[i] != STDIN_FILENO)
+        {
+            // o estagio le o arquivo direto; o pipe do anterior fica sem leitor
+            if (in_fd != STDIN_FILENO) close(in_fd);
+            in_fd = ins[i];
+            if (measured)
+            {
+                pid_t relay = start_input_relay(i, &in_fd);
+                if (relay > 0)
+                    pids[MAX_STAGES + helpers++] = relay;
+            }
+        }
+
+        // Lança o processo para o "comando atual"
+        select_stage_cpus(i, stage_count);
+        pids[i] = launch_process(in_fd, out_fd, stages[i]);
+
+        // Fecha os "pipes de escrita" no processo pai
+        if (in_fd != STDIN_FILENO) close(in_fd);
+        
+        if (out_fd != STDOUT_FILENO) close(out_fd);
+
+        // A entrada para o proximo comando sera a leitura do pipe atual
+        if (i < stage_count - 1) in_fd = fd[0];
+
+        if (measured && i < stage_count - 1)
+        {
+            pid_t relay = start_relay(i, &in_fd);
+            if (relay > 0)
+                pids[MAX_STAGES + helpers++] = relay;
+        }
+    }
+
+    int tail_status = 0;
+    if (inline_last)
+    {
+        // fechar a leitura assim que o head termina manda SIGPIPE para tras
+        fflush(stdout);
+        if (ins[stage_count - 1] != STDIN_FILENO)
+        {
+            close(in_fd);
+            in_fd = ins[stage_count - 1];
+        }
+        TRACE('B', "inline", stages[stage_count - 1][0], "in", in_fd, "out", last_out_fd);
+        tail_status = ts_run(stages[stage_count - 1], in_fd, last_out_fd);
+        TRACE('E', "inline", stages[stage_count - 1][0], "status", tail_status, NULL, 0);
+        close(in_fd);
+        if (last_out_fd != STDOUT_FILENO) close(last_out_fd);
+    }
+
+    // relays e fan-outs vao para depois dos estagios, o status continua sendo o do ultimo estagio
+    for (int r = 0; r < helpers; r++)
+        pids[launched + r] = pids[MAX_STAGES + r];
+    if (!inline_last)
+        return job_start(pids, stage_count + helpers, stage_count - 1, true);
+
+    // sem processo para o ultimo estagio: o status do job e o do builtin
+    int j = job_start(pids, launched + helpers, -1, true);
+    if (j >= 0)
+        jobs[j].status = W_EXITCODE(tail_status, 0);
+    return j;
+}
+
+// ! intervalo de tempo em segundos entre dois instantes
+static double elapsed(struct timespec *a, struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+// ! imprime o resumo de um link da pipeline medida no stderr; label e
+// ! "1->2" entre estagios ou "entrada->1" para um "< arq"
+static void relay_report(const char *label, const char *tag, long long bytes, double secs,
+                         double producer_wait, double consumer_wait)
+{
+    double mib = bytes / (1024.0 * 1024.0);
+    dprintf(STDERR_FILENO,
+            "[measure %s] %s: %.2f MiB em %.2fs (%.2f MiB/s), "
+            "sem dados do produtor %.2fs, consumidor cheio %.2fs\n",
+            tag, label, mib, secs, secs > 0 ? mib / secs : 0.0,
+            producer_wait, consumer_wait);
+}
+
+// ! corpo do relay: splice de in_fd para out_fd contando bytes e tempo bloqueado
+static void relay_loop(const char *label, int in_fd, int out_fd)
+{
+    long long bytes = 0;
+    unsigned splices = 0;
+    double producer_wait = 0, consumer_wait = 0;
+    struct timespec start, now, last_report;
+
+    fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(out_fd, F_SETFL, fcntl(out_fd, F_GETFL) | O_NONBLOCK);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    last_report = start;
+
+    while (1)
+    {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, RELAY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0)
+        {
+            bytes += n;
+            // fluxo sem espera tambem precisa do resumo parcial (clock_gettime e vDSO)
+            if ((++splices & 63) == 0)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (elapsed(&last_report, &now) * 1000 >= RELAY_REPORT_MS)
+                {
+                    relay_report(label, "live", bytes, elapsed(&start, &now), producer_wait, consumer_wait);
+                    last_report = now;
+                }
+            }
+            continue;
+        }
+        if (n == 0)
+            break; // produtor fechou o pipe
+        if (errno != EAGAIN)
+            break; // EPIPE: consumidor saiu
+
+        // o splice parou: descobre qual lado esta segurando e mede a espera
+        struct pollfd pin = {in_fd, POLLIN, 0};
+        bool starving = poll(&pin, 1, 0) == 0;
+        struct pollfd pfd = starving ? pin : (struct pollfd){out_fd, POLLOUT, 0};
+        struct timespec t0, t1;
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        poll(&pfd, 1, RELAY_REPORT_MS);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (starving)
+            producer_wait += elapsed(&t0, &t1);
+        else
+            consumer_wait += elapsed(&t0, &t1);
+
+        // resumo parcial no maximo uma vez por intervalo, so enquanto a pipeline roda
+        if (elapsed(&last_report, &t1) * 1000 >= RELAY_REPORT_MS)
+        {
+            relay_report(label, "live", bytes, elapsed(&start, &t1), producer_wait, consumer_wait);
+            last_report = t1;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    relay_report(label, "final", bytes, elapsed(&start, &now), producer_wait, consumer_wait);
+}
+
+// ! troca *in_fd (leitura do pipe do estagio link) por um pipe novo alimentado
+// ! por um relay medido; retorna o pid do relay
+pid_t start_relay(int link, int *in_fd)
+{
+    int out[2];
+    char label[32];
+
+    snprintf(label, sizeof(label), "%d->%d", link + 1, link + 2);
+    if (pipe2(out, O_CLOEXEC) == -1)
+    {
+        perror("pipe error");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork error");
+        close(out[0]);
+        close(out[1]);
+        return -1; // o proximo estagio le direto do pipe original
+    }
+
+    if (pid == 0)
+    {
+        trace_child();
+        sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+        signal(SIGPIPE, SIG_IGN); // consumidor saindo vira EPIPE e o relay ainda reporta
+        close(out[0]);
+        relay_loop(label, *in_fd, out[1]);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(*in_fd);
+    close(out[1]);
+    *in_fd = out[0];
+    return pid;
+}
+
+// ! corpo do relay de um "< arq" medido: o arquivo e mapeado e as paginas vao
+// ! para o pipe com vmsplice, sem copia; o que nao mapeia (fifo, /proc) cai
+// ! no splice do relay_loop
+static void input_relay_loop(const char *label, int in_fd, int out_fd)
+{
+    struct stat st;
+    char *map = MAP_FAILED;
+
+    if (fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, in_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        relay_loop(label, in_fd, out_fd);
+        return;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    fcntl(out_fd, F_SETPIPE_SZ, RELAY_CHUNK * 4);
+
+    long long bytes = 0;
+    double consumer_wait = 0;
+    struct timespec start, now, last_report, t0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    last_report = start;
+
+    while (bytes < st.st_size)
+    {
+        size_t left = (size_t)(st.st_size - bytes);
+        struct iovec iov = {map + bytes, left < RELAY_CHUNK ? left : RELAY_CHUNK};
+
+        // vmsplice so bloqueia com o pipe cheio: esse tempo e do consumidor
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        ssize_t n = vmsplice(out_fd, &iov, 1, 0);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        consumer_wait += elapsed(&t0, &now);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break; // EPIPE: consumidor saiu
+        bytes += n;
+
+        if (elapsed(&last_report, &now) * 1000 >= RELAY_REPORT_MS)
+        {
+            relay_report(label, "live", bytes, elapsed(&start, &now), 0, consumer_wait);
+            last_report = now;
+        }
+    }
+
+    // as paginas ja no pipe continuam referenciadas depois do munmap
+    munmap(map, st.st_size);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    relay_report(label, "final", bytes, elapsed(&start, &now), 0, consumer_wait);
+}
+
+// ! troca *in_fd (arquivo de "< arq" do estagio stage) por um pipe alimentado
+// ! pelo relay medido; retorna o pid do relay
+pid_t start_input_relay(int stage, int *in_fd)
+{
+    int out[2];
+    char label[32];
+
+    snprintf(label, sizeof(label), "entrada->%d", stage + 1);
+    if (pipe2(out, O_CLOEXEC) == -1)
+    {
+        perror("pipe error");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork error");
+        close(out[0]);
+        close(out[1]);
+        return -1; // o estagio le direto do arquivo
+    }
+
+    if (pid == 0)
+    {
+        trace_child();
+        sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+        signal(SIGPIPE, SIG_IGN);
+        close(out[0]);
+        input_relay_loop(label, *in_fd, out[1]);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(*in_fd);
+    close(out[1]);
+    *in_fd = out[0];
+    return pid;
+}
+
+// ! conta a quantidade de argumentos em cada comando
+int count_args(char **args)
+{
+    int count = 0;
+    if(args == NULL) return 0;
+
+    while (args[count] != NULL)
+    {
+        count++;
+    }
+    return count;
+}
+
+// ! verifica se o comando e valido e se seus argumentos sao validos 
+bool validate_command(char **args)
+{
+
+    char *command = args[0];
+    int num_args = count_args(args) - 1;
+
+    if (strcmp(command, "cd") == 0)
+    {
+        if (num_args != 1)
+        {
+            fprintf(stderr, "uso: cd <dretorio>\n");
+            return false;
+        }
+        return 1;
+    }else if (strcmp(command, "ls") == 0)
+    {
+        return true;
+    }else if (strcmp(command, "pwd") == 0)
+    {
+        if (num_args != 0)
+        {
+            fprintf(stderr, "uso: pwd\n");
+            return false;
+        }
+        return true;
+    }else if (strcmp(command, "cat") == 0)
+    {
+        if (num_args < 1)
+        {
+            fprintf(stderr, "uso: cat <arquivo> [arquivo2 ...]\n");
+            return false;
+        }
+        return true;
+    }else
+    {
+        return true;
+    }
+}
+
+// ! guarda um bloco que os argv da linha atual apontam, liberado na proxima linha
+static void keep_line_alloc(char *ptr)
+{
+    if (line_alloc_count == line_alloc_cap)
+    {
+        line_alloc_cap = line_alloc_cap ? line_alloc_cap * 2 : 16;
+        line_allocs = realloc(line_allocs, line_alloc_cap * sizeof(char *));
+        if (line_allocs == NULL)
+        {
+            fprintf(stderr, "erro de alocacao\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    line_allocs[line_alloc_count++] = ptr;
+}
+
+void free_line_allocs(void)
+{
+    for (int i = 0; i < line_alloc_count; i++)
+        free(line_allocs[i]);
+    line_alloc_count = 0;
+    // corpos de here-doc que nenhum estagio chegou a abrir
+    for (int i = 0; i < heredoc_count; i++)
+        if (heredocs[i].fd >= 0)
+            close(heredocs[i].fd);
+    heredoc_count = 0;
+}
+
+// ! garante espaco para mais extra bytes; cresce dobrando para nao ficar quadratico
+void buffer_reserve(Buffer *b, size_t extra)
+{
+    if (b->len + extra <= b->cap)
+        return;
+
+    size_t cap = b->cap ? b->cap : CAPTURE_CHUNK;
+    while (cap < b->len + extra)
+        cap *= 2;
+
+    b->data = realloc(b->data, cap);
+    if (b->data == NULL)
+    {
+        fprintf(stderr, "erro de alocacao\n");
+        exit(EXIT_FAILURE);
+    }
+    b->cap = cap;
+}
+
+void buffer_append(Buffer *b, const char *data, size_t len)
+{
+    buffer_reserve(b, len);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+// ! roda o texto de uma substituicao e acrescenta a saida dele em out
+static int capture_command(const char *text, size_t len, Buffer *out)
+{
+    char *cmd = strndup(text, len);
+    char *procs_args[MAX_PROCS][MAX_ARGS + 1];
+    char *stages[MAX_STAGES][MAX_ARGS + 1];
+    int procs = simultaneos_proc(cmd, procs_args);
+    int ret = 0;
+
+    keep_line_alloc(cmd); // argv aninhados podem apontar para cmd
+
+    int fd[2] = {-1, -1};
+    int started[MAX_PROCS];
+    int nstarted = 0;
+    bool aborted = false; // erro que interrompe as pipelines seguintes
+
+    for (int p = 0; p < procs && !aborted; p++)
+    {
+        int count = split_pipeline_args(procs_args[p], stages);
+        if (expand_substitutions(stages, count) < 0 || stages[0][0] == NULL)
+        {
+            ret = -1;
+            continue;
+        }
+
+        // cd numa substituicao roda num filho: "$(cd /)" nao muda o diretorio
+        // da shell nem o do processo que hospeda a libshell
+        if (count == 1 && strcmp(stages[0][0], "cd") == 0)
+        {
+            fflush(NULL);
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+                _exit(run_builtin(stages[0], stdout));
+            }
+            if (pid > 0)
+                waitpid(pid, NULL, 0);
+            continue;
+        }
+
+        // builtin sozinho roda sem fork, escrevendo direto num buffer de memoria
+        if (count == 1 && is_builtin(stages[0][0]))
+        {
+            char *mem = NULL;
+            size_t mem_len = 0;
+            FILE *f = open_memstream(&mem, &mem_len);
+            if (f == NULL)
+            {
+                ret = -1;
+                aborted = true;
+                continue;
+            }
+            run_builtin(stages[0], f);
+            fclose(f);
+            buffer_append(out, mem, mem_len);
+            free(mem);
+            continue;
+        }
+
+        if (fd[0] < 0 && pipe2(fd, O_CLOEXEC) == -1)
+        {
+            perror("pipe error");
+            ret = -1;
+            aborted = true;
+            continue;
+        }
+
+        // cada pipeline fecha a sua copia da escrita depois de lancar
+        int w = dup(fd[1]);
+        int j = w < 0 ? -1 : execute_pipeline(stages, count, w);
+        if (j >= 0)
+            started[nstarted++] = j;
+    }
+
+    // saida unica: o pipe e fechado e todo job lancado e esperado, tambem
+    // depois de um erro, para nada ficar pendurado no wait_foreground
+    if (fd[0] < 0)
+        return ret; // sem pipe nenhum job foi lancado
+    close(fd[1]);
+
+    // le ate o EOF direto no espaco livre do buffer, sem copia intermediaria;
+    // depois de um erro o pipe so e fechado e os jobs recebem EPIPE
+    while (!aborted)
+    {
+        buffer_reserve(out, CAPTURE_CHUNK);
+        ssize_t r = read(fd[0], out->data + out->len, out->cap - out->len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        out->len += (size_t)r;
+    }
+    close(fd[0]);
+
+    for (int i = 0; i < nstarted; i++)
+        wait_job(started[i]);
+    return ret;
+}
+
+// ! saida inteira de cmd terminada em '\0' (listas de for dos scripts); o
+// ! chamador libera com free
+char *capture_output(const char *cmd)
+{
+    Buffer out = {NULL, 0, 0};
+    if (capture_command(cmd, strlen(cmd), &out) < 0)
+    {
+        free(out.data);
+        return NULL;
+    }
+    buffer_append(&out, "", 1);
+    return out.data;
+}
+
+// ! expande $(...) e `...` de um argumento, devolve as palavras em words
+static int expand_arg(char *arg, char **words, int max)
+{
+    Buffer text = {NULL, 0, 0};
+    char *p = arg;
+
+    while (*p != '\0')
+    {
+        if ((p[0] == '$' && p[1] == '(') || p[0] == '`')
+        {
+            char *end = skip_subst(p);
+            char *body = p + (p[0] == '`' ? 1 : 2);
+            size_t body_len = (size_t)(end - body);
+            if (body_len > 0 && (end[-1] == ')' || end[-1] == '`') && end > body)
+                body_len--; // tira o fechamento
+            if (capture_command(body, body_len, &text) < 0)
+            {
+                free(text.data);
+                return -1;
+            }
+            // como no sh, os \n finais da saida nao viram separador
+            while (text.len > 0 && text.data[text.len - 1] == '\n')
+                text.len--;
+            p = end;
+        }
+        else
+        {
+            buffer_append(&text, p, 1);
+            p++;
+        }
+    }
+    buffer_append(&text, "", 1);
+    keep_line_alloc(text.data);
+
+    // separa em palavras no proprio buffer
+    int count = 0;
+    char *saveptr;
+    char *word = strtok_r(text.data, " \t\n", &saveptr);
+    while (word != NULL)
+    {
+        if (count == max)
+        {
+            fprintf(stderr, "erro: substituicao gerou argumentos demais (max %d)\n", MAX_ARGS);
+            return -1;
+        }
+        words[count++] = word;
+        word = strtok_r(NULL, " \t\n", &saveptr);
+    }
+    return count;
+}
+
+// ! troca os argumentos com substituicao pelas palavras da saida; -1 em erro
+int expand_substitutions(char *stages[MAX_STAGES][MAX_ARGS + 1], int stage_count)
+{
+    for (int s = 0; s < stage_count; s++)
+    {
+        for (int i = 0; stages[s][i] != NULL; i++)
+        {
+            if (strstr(stages[s][i], "$(") == NULL && strchr(stages[s][i], '`') == NULL)
+                continue;
+
+            char *rest[MAX_ARGS + 1];
+            int nrest = 0;
+            for (int k = i + 1; stages[s][k] != NULL; k++)
+                rest[nrest++] = stages[s][k];
+
+            int n = expand_arg(stages[s][i], &stages[s][i], MAX_ARGS - i - nrest);
+            if (n < 0)
+                return -1;
+
+            for (int k = 0; k < nrest; k++)
+                stages[s][i + n + k] = rest[k];
+            stages[s][i + n + nrest] = NULL;
+            i += n - 1;
+        }
+    }
+    return 0;
+}
+
+// ! status no formato do sh; job encerrado pelo timeout sai com 124, ou 137
+// ! se precisou de SIGKILL, como o timeout do coreutils
+static int job_exit_code(Job *job)
+{
+    int status = job->status;
+    if (job->timeout_phase == 2)
+        return 128 + SIGKILL;
+    if (job->timeout_phase == 1)
+        return TIMEOUT_STATUS;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// ! espera um job especifico terminar sem parar o loop de eventos; retorna o
+// ! codigo de saida no formato do sh (128 + sinal quando morto por sinal)
+int wait_job(int j)
+{
+    if (j < 0)
+        return 1;
+
+    TRACE('B', "wait_job", NULL, "job", j, NULL, 0);
+    while (jobs[j].used)
+    {
+        // sem signalfd (modo embutido) processos sem pidfd nao acordam o loop
+        bool blind = false;
+        for (int i = 0; i < jobs[j].count; i++)
+            if (jobs[j].pids[i] > 0 && jobs[j].pidfds[i] < 0)
+                blind = true;
+
+        if (blind && sigfd < 0)
+        {
+            // espera sem coletar; quem coleta e atualiza o job e o reap_children
+            siginfo_t info;
+            for (int i = 0; i < jobs[j].count; i++)
+                if (jobs[j].pids[i] > 0 && jobs[j].pidfds[i] < 0)
+                    waitid(P_PID, jobs[j].pids[i], &info, WEXITED | WNOWAIT);
+            reap_children();
+        }
+        else
+        {
+            pump_events(-1);
+        }
+    }
+
+    TRACE('E', "wait_job", NULL, "job", j, "status", jobs[j].status);
+    return job_exit_code(&jobs[j]);
+}
+
+// ! reserva (ou libera) o slot de um job para que o resultado nao seja
+// ! sobrescrito por outro job_start antes do dono ler com job_result
+void job_hold(int j, bool hold)
+{
+    if (j >= 0)
+        jobs[j].held = hold;
+}
+
+// ! true se o job terminou, preenchendo o status (formato do sh) e o rusage
+bool job_result(int j, int *status, struct rusage *usage)
+{
+    if (j < 0 || jobs[j].used)
+        return false;
+
+    *status = job_exit_code(&jobs[j]);
+    if (usage != NULL)
+        *usage = jobs[j].usage;
+    return true;
+}
+
+// ! manda sig para os processos do job que ainda estao vivos
+void job_signal(int j, int sig)
+{
+    if (j < 0 || !jobs[j].used)
+        return;
+    for (int i = 0; i < jobs[j].count; i++)
+        if (jobs[j].pids[i] > 0)
+            kill(jobs[j].pids[i], sig);
+}
+
+// ! fd do epoll do nucleo; fica legivel quando pump_events tem o que tratar
+int events_fd(void)
+{
+    return epfd;
+}
+
+// ! caminho de saida relativo ao cwd do ExecEnv atual; append para ">>"
+int open_output(const char *file, bool append)
+{
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+    if (exec_env != NULL && exec_env->cwd != NULL && file[0] != '/')
+    {
+        char full[PATH_MAX];
+        snprintf(full, sizeof(full), "%s/%s", exec_env->cwd, file);
+        return open(full, flags, 0644);
+    }
+    return open(file, flags, 0644);
+}
+
+// ! abre o arquivo de "< arq" relativo ao diretorio do ExecEnv, como open_output
+int open_input(const char *file)
+{
+    if (exec_env != NULL && exec_env->cwd != NULL && file[0] != '/')
+    {
+        char full[PATH_MAX];
+        snprintf(full, sizeof(full), "%s/%s", exec_env->cwd, file);
+        return open(full, O_RDONLY | O_CLOEXEC);
+    }
+    return open(file, O_RDONLY | O_CLOEXEC);
+}
+
+// ! valor do PATH visto pelos filhos do ExecEnv atual
+static const char *current_path_var(void)
+{
+    for (int i = 0; exec_env != NULL && exec_env->vars != NULL && exec_env->vars[i] != NULL; i++)
+        if (strncmp(exec_env->vars[i], "PATH=", 5) == 0)
+            return exec_env->vars[i] + 5;
+
+    const char *path = getenv("PATH");
+    return path != NULL ? path : "/bin:/usr/bin";
+}
+
+void path_cache_clear(PathCache *cache)
+{
+    for (int i = 0; i < PATH_CACHE_SIZE; i++)
+    {
+        free(cache->names[i]);
+        free(cache->paths[i]);
+        cache->names[i] = NULL;
+        cache->paths[i] = NULL;
+    }
+    free(cache->path_var);
+    cache->path_var = NULL;
+}
+
+// ! caminho completo de cmd; NULL se nao achar (o exec tenta o execvp)
+const char *path_cache_lookup(PathCache *cache, const char *cmd)
+{
+    const char *path_var = current_path_var();
+
+    if (strchr(cmd, '/') != NULL)
+        return NULL;
+
+    if (cache->path_var == NULL || strcmp(cache->path_var, path_var) != 0)
+    {
+        path_cache_clear(cache);
+        cache->path_var = strdup(path_var);
+    }
+
+    unsigned h = 5381;
+    for (const char *p = cmd; *p != '\0'; p++)
+        h = h * 33 + (unsigned char)*p;
+
+    // enderecamento aberto; cheio, o slot de origem e sobrescrito
+    unsigned slot = h % PATH_CACHE_SIZE;
+    for (int probe = 0; probe < PATH_CACHE_SIZE; probe++)
+    {
+        unsigned i = (slot + probe) % PATH_CACHE_SIZE;
+        if (cache->names[i] == NULL)
+        {
+            slot = i;
+            break;
+        }
+        if (strcmp(cache->names[i], cmd) == 0)
+            return cache->paths[i];
+    }
+
+    char *dirs = strdup(path_var);
+    char *saveptr;
+    char full[PATH_MAX];
+    const char *found = NULL;
+    for (char *dir = strtok_r(dirs, ":", &saveptr); dir != NULL; dir = strtok_r(NULL, ":", &saveptr))
+    {
+        snprintf(full, sizeof(full), "%s/%s", *dir ? dir : ".", cmd);
+        if (access(full, X_OK) == 0)
+        {
+            found = full;
+            break;
+        }
+    }
+    free(dirs);
+
+    if (found == NULL)
+        return NULL;
+
+    free(cache->names[slot]);
+    free(cache->paths[slot]);
+    cache->names[slot] = strdup(cmd);
+    cache->paths[slot] = strdup(found);
+    return cache->paths[slot];
+}
+
+// ! comandos que rodam dentro da shell
+int is_builtin(char *comand)
+{
+    return strcmp(comand, "cd") == 0 || strcmp(comand, "pwd") == 0
+        || strcmp(comand, "echo") == 0 || strcmp(comand, "true") == 0
+        || strcmp(comand, "false") == 0 || strcmp(comand, ":") == 0
+        || strcmp(comand, "test") == 0 || strcmp(comand, "[") == 0;
+}
+
+// ! "-f arq", "a = b", "n -lt m"... de test/[; -1 = expressao invalida
+static int test_expr(char **a, int n)
+{
+    if (n > 0 && strcmp(a[0], "!") == 0)
+    {
+        int r = test_expr(a + 1, n - 1);
+        return r < 0 ? r : !r;
+    }
+    if (n == 0)
+        return 0;
+    if (n == 1)
+        return a[0][0] != '\0';
+
+    if (n == 2 && a[0][0] == '-' && a[0][1] != '\0' && a[0][2] == '\0')
+    {
+        struct stat st;
+        const char *s = a[1];
+        switch (a[0][1])
+        {
+        case 'z': return s[0] == '\0';
+        case 'n': return s[0] != '\0';
+        case 'e': return stat(s, &st) == 0;
+        case 'f': return stat(s, &st) == 0 && S_ISREG(st.st_mode);
+        case 'd': return stat(s, &st) == 0 && S_ISDIR(st.st_mode);
+        case 's': return stat(s, &st) == 0 && st.st_size > 0;
+        case 'r': return access(s, R_OK) == 0;
+        case 'w': return access(s, W_OK) == 0;
+        case 'x': return access(s, X_OK) == 0;
+        }
+        return -1;
+    }
+
+    if (n == 3)
+    {
+        const char *op = a[1];
+        if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+            return strcmp(a[0], a[2]) == 0;
+        if (strcmp(op, "!=") == 0)
+            return strcmp(a[0], a[2]) != 0;
+
+        static const char *ops[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+        char *end_l, *end_r;
+        long l = strtol(a[0], &end_l, 10);
+        long r = strtol(a[2], &end_r, 10);
+        for (int i = 0; i < 6; i++)
+        {
+            if (strcmp(op, ops[i]) != 0)
+                continue;
+            if (*a[0] == '\0' || *end_l != '\0' || *a[2] == '\0' || *end_r != '\0')
+                return -1;
+            switch (i)
+            {
+            case 0: return l == r;
+            case 1: return l != r;
+            case 2: return l < r;
+            case 3: return l <= r;
+            case 4: return l > r;
+            default: return l >= r;
+            }
+        }
+    }
+    return -1;
+}
+
+// ! executa um builtin escrevendo em out; retorna o status
+int run_builtin(char **args, FILE *out)
+{
+    if (strcmp(args[0], "cd") == 0)
+    {
+        if (args[1] == NULL || args[2] != NULL)
+        {
+            fprintf(stderr, "uso: cd <dretorio>\n");
+            return 1;
+        }
+        if (chdir(args[1]) != 0)
+        {
+            perror("cd");
+            return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(args[0], "pwd") == 0)
+    {
+        // libshell e daemon guardam o diretorio no ExecEnv, sem mudar o do processo
+        if (exec_env != NULL && exec_env->cwd != NULL)
+        {
+            fprintf(out, "%s\n", exec_env->cwd);
+            return 0;
+        }
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd)) == NULL)
+        {
+            perror("pwd");
+            return 1;
+        }
+        fprintf(out, "%s\n", cwd);
+        return 0;
+    }
+
+    if (strcmp(args[0], "echo") == 0)
+    {
+        for (int i = 1; args[i] != NULL; i++)
+            fprintf(out, i > 1 ? " %s" : "%s", args[i]);
+        fprintf(out, "\n");
+        return 0;
+    }
+
+    if (strcmp(args[0], "true") == 0 || strcmp(args[0], ":") == 0)
+        return 0;
+    if (strcmp(args[0], "false") == 0)
+        return 1;
+
+    if (strcmp(args[0], "test") == 0 || strcmp(args[0], "[") == 0)
+    {
+        int n = count_args(args) - 1;
+        if (args[0][0] == '[' && (n == 0 || strcmp(args[n], "]") != 0))
+        {
+            fprintf(stderr, "[: falta o ']'\n");
+            return 2;
+        }
+        int r = test_expr(args + 1, args[0][0] == '[' ? n - 1 : n);
+        if (r < 0)
+        {
+            fprintf(stderr, "%s: expressao invalida\n", args[0]);
+            return 2;
+        }
+        return r ? 0 : 1;
+    }
+    return 1;
+}
+
+// ! remove o prefixo "... --" de args; retorna -1 se nao houver "--"
+// ! (args fica intacto) ou o indice onde o "--" estava
+int strip_prefix(char **args)
+{
+    int sep = 0;
+    while (args[sep] != NULL && strcmp(args[sep], "--") != 0)
+        sep++;
+
+    if (args[sep] == NULL)
+        return -1;
+
+    int k = 0;
+    for (int j = sep + 1; args[j] != NULL; j++)
+        args[k++] = args[j];
+    args[k] = NULL;
+    return sep;
+}
+
+// ! cria o epoll; interativo tambem bloqueia os sinais tratados pelo loop e
+// ! registra stdin e signalfd. Embutido (libshell) so usa pidfds, sem mexer
+// ! nos sinais nem nos filhos do processo hospedeiro
+void init_events(bool interactive)
+{
+    sigset_t mask;
+    struct epoll_event ev;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epfd < 0 || tfd < 0)
+    {
+        perror("erro ao criar o loop de eventos");
+        if (interactive)
+            exit(EXIT_FAILURE);
+    }
+
+    // prazos de timeout acordam o loop pelo timerfd, sem polling
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)EV_TIMER << 32;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+
+    if (!interactive)
+    {
+        sigprocmask(SIG_BLOCK, NULL, &orig_mask);
+        return;
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, &orig_mask);
+
+    sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigfd < 0)
+    {
+        perror("erro ao criar o loop de eventos");
+        exit(EXIT_FAILURE);
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)EV_SIGNAL << 32;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev);
+
+    // oneshot: stdin so e rearmado quando a shell quer ler uma linha
+    ev.events = 0;
+    ev.data.u64 = (uint64_t)EV_STDIN << 32;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) < 0)
+        stdin_polled = false; // arquivo comum: sempre pronto para leitura
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// ! arma o timerfd no prazo mais proximo entre os jobs (ou desarma)
+static void arm_timer(void)
+{
+    uint64_t next = 0;
+    for (int j = 0; j < MAX_JOBS; j++)
+        if (jobs[j].used && jobs[j].deadline != 0 && (next == 0 || jobs[j].deadline < next))
+            next = jobs[j].deadline;
+
+    struct itimerspec its = {{0, 0}, {(time_t)(next / 1000000000ull), (long)(next % 1000000000ull)}};
+    if (tfd >= 0)
+        timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// ! manda sig para o grupo do job e para os processos fora dele (relays)
+static void signal_job_group(Job *job, int sig)
+{
+    if (job->pgid > 0)
+        killpg(job->pgid, sig);
+    for (int i = 0; i < job->count; i++)
+        if (job->pids[i] > 0 && getpgid(job->pids[i]) != job->pgid)
+            kill(job->pids[i], sig);
+}
+
+// ! diz no stderr quais estagios ainda rodavam quando o prazo acabou
+static void report_timeout(int j)
+{
+    Job *job = &jobs[j];
+    fprintf(stderr, "timeout: job %d passou de %.3gs, SIGTERM para o grupo %d\n",
+            j + 1, job->timeout.term_ms / 1000.0, job->pgid);
+
+    for (int i = 0; i < job->count; i++)
+    {
+        if (job->pids[i] <= 0)
+            continue;
+
+        char path[64];
+        char comm[64] = "?";
+        snprintf(path, sizeof(path), "/proc/%d/comm", job->pids[i]);
+        FILE *f = fopen(path, "r");
+        if (f != NULL)
+        {
+            if (fgets(comm, sizeof(comm), f) != NULL)
+                comm[strcspn(comm, "\n")] = '\0';
+            fclose(f);
+        }
+
+        if (i <= job->last)
+            fprintf(stderr, "timeout:   estagio %d (%s, pid %d) ainda rodando\n", i + 1, comm, job->pids[i]);
+        else
+            fprintf(stderr, "timeout:   relay (%s, pid %d) ainda rodando\n", comm, job->pids[i]);
+    }
+}
+
+// ! aplica os prazos vencidos: SIGTERM no primeiro, SIGKILL no segundo
+static void check_timeouts(void)
+{
+    uint64_t now = monotonic_ns();
+
+    for (int j = 0; j < MAX_JOBS; j++)
+    {
+        Job *job = &jobs[j];
+        if (!job->used || job->deadline == 0 || job->deadline > now)
+            continue;
+
+        if (job->timeout_phase == 0)
+        {
+            report_timeout(j);
+            TRACE('i', "timeout", NULL, "job", j, "signal", SIGTERM);
+            signal_job_group(job, SIGTERM);
+            signal_job_group(job, SIGCONT); // parado nao receberia o SIGTERM
+            job->timeout_phase = 1;
+            job->deadline = job->timeout.kill_ms > 0 ? now + job->timeout.kill_ms * 1000000ull : 0;
+        }
+        else
+        {
+            fprintf(stderr, "timeout: job %d ignorou o SIGTERM, SIGKILL para o grupo %d\n", j + 1, job->pgid);
+            TRACE('i', "timeout", NULL, "job", j, "signal", SIGKILL);
+            signal_job_group(job, SIGKILL);
+            job->timeout_phase = 2;
+            job->deadline = 0;
+        }
+    }
+    arm_timer();
+}
+
+// ! espera eventos por ate timeout_ms (-1 bloqueia) e trata os que chegaram
+void pump_events(int timeout_ms)
+{
+    struct epoll_event evs[MAX_EVENTS];
+    int n = epoll_wait(epfd, evs, MAX_EVENTS, timeout_ms);
+
+    if (n < 0 && errno != EINTR)
+    {
+        perror("epoll_wait");
+        return;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        switch (evs[i].data.u64 >> 32)
+        {
+        case EV_STDIN:
+            stdin_ready = true;
+            break;
+        case EV_SIGNAL:
+        {
+            struct signalfd_siginfo si;
+            while (read(sigfd, &si, sizeof(si)) == sizeof(si))
+            {
+                if (si.ssi_signo == SIGCHLD)
+                    reap_children();
+                else if (si.ssi_signo == SIGINT)
+                {
+                    interrupted = true; // os filhos em primeiro plano recebem o sinal do terminal
+                    interrupt_pending = true; // o wait_foreground limpa interrupted, este fica
+                    // menos os grupos proprios das pipelines com timeout
+                    for (int j = 0; j < MAX_JOBS; j++)
+                        if (jobs[j].used && jobs[j].pgid > 0)
+                            killpg(jobs[j].pgid, SIGINT);
+                }
+            }
+            break;
+        }
+        case EV_PIDFD:
+            reap_children();
+            break;
+        case EV_TIMER:
+        {
+            uint64_t expirations;
+            if (read(tfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+                perror("timerfd");
+            check_timeouts();
+            break;
+        }
+        case EV_WATCH:
+            watch_ready = true;
+            break;
+        }
+    }
+}
+
+// ! coleta os filhos dos jobs que terminaram; so olha pids conhecidos para
+// ! nao roubar filhos do processo hospedeiro quando embutido
+void reap_children(void)
+{
+    for (int j = 0; j < MAX_JOBS; j++)
+    {
+        Job *job = &jobs[j];
+        if (!job->used)
+            continue;
+
+        for (int i = 0; i < job->count && job->used; i++)
+        {
+            int status;
+            struct rusage ru;
+            if (job->pids[i] <= 0 || wait4(job->pids[i], &status, WNOHANG, &ru) != job->pids[i])
+                continue;
+
+            TRACE('i', "exit", NULL, "pid", job->pids[i], "status", status);
+            timeradd(&job->usage.ru_utime, &ru.ru_utime, &job->usage.ru_utime);
+            timeradd(&job->usage.ru_stime, &ru.ru_stime, &job->usage.ru_stime);
+            if (ru.ru_maxrss > job->usage.ru_maxrss)
+                job->usage.ru_maxrss = ru.ru_maxrss;
+            job->usage.ru_minflt += ru.ru_minflt;
+            job->usage.ru_majflt += ru.ru_majflt;
+            job->usage.ru_nvcsw += ru.ru_nvcsw;
+            job->usage.ru_nivcsw += ru.ru_nivcsw;
+
+            if (job->pidfds[i] >= 0)
+                close(job->pidfds[i]); // sai do epoll junto com o fd
+            job->pids[i] = 0;
+            job->pidfds[i] = -1;
+            if (i == job->last)
+                job->status = status;
+
+            if (--job->alive == 0)
+            {
+                if (!job->foreground)
+                    fprintf(stderr, "[%d] concluido\n", j + 1);
+                job->used = false;
+            }
+        }
+    }
+}
+
+// ! registra os processos de uma pipeline no loop, retorna o indice do job
+int job_start(pid_t *pids, int count, int last, bool foreground)
+{
+    int j = 0;
+    while (j < MAX_JOBS && (jobs[j].used || jobs[j].held))
+        j++;
+
+    if (j == MAX_JOBS)
+    {
+        // sem espaco: espera de forma sincrona para nao perder os filhos
+        fprintf(stderr, "erro: muitos jobs, esperando a pipeline\n");
+        for (int i = 0; i < count; i++)
+            if (pids[i] > 0) waitpid(pids[i], NULL, 0);
+        return -1;
+    }
+
+    Job *job = &jobs[j];
+    job->used = true;
+    job->foreground = foreground;
+    job->alive = 0;
+    job->count = count;
+    job->last = last;
+    job->status = 0;
+    memset(&job->usage, 0, sizeof(job->usage));
+    job->pgid = group_timed ? group_leader : 0;
+    job->timeout_phase = 0;
+    job->deadline = 0;
+    if (group_timed)
+    {
+        job->timeout = *current_timeout;
+        job->deadline = monotonic_ns() + current_timeout->term_ms * 1000000ull;
+    }
+    group_timed = false;
+
+    for (int i = 0; i < count; i++)
+    {
+        job->pids[i] = pids[i];
+        job->pidfds[i] = -1;
+        if (pids[i] <= 0)
+            continue;
+        job->alive++;
+
+        // sem pidfd (kernel antigo) o SIGCHLD continua acordando o loop
+        int pfd = (int)syscall(SYS_pidfd_open, pids[i], 0);
+        if (pfd >= 0)
+        {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u64 = ((uint64_t)EV_PIDFD << 32) | (uint32_t)(j * MAX_JOB_PROCS + i);
+            epoll_ctl(epfd, EPOLL_CTL_ADD, pfd, &ev);
+            job->pidfds[i] = pfd;
+        }
+    }
+
+    if (job->alive == 0)
+        job->used = false;
+    else
+        reap_children(); // algum pode ter terminado antes do pidfd existir
+    if (job->used && job->deadline != 0)
+        arm_timer();
+    return j;
+}
+
+// ! roda o loop ate todos os jobs em primeiro plano terminarem
+void wait_foreground(void)
+{
+    TRACE('B', "wait_foreground", NULL, NULL, 0, NULL, 0);
+    while (1)
+    {
+        bool running = false;
+        for (int j = 0; j < MAX_JOBS; j++)
+            if (jobs[j].used && jobs[j].foreground)
+                running = true;
+
+        if (!running)
+            break;
+        pump_events(-1);
+    }
+    interrupted = false;
+    TRACE('E', "wait_foreground", NULL, NULL, 0, NULL, 0);
+}
+
+// ! true (uma vez) se chegou um ctrl-c desde a ultima consulta, para os lacos
+// ! dos scripts pararem; com poll trata antes os eventos pendentes sem bloquear
+bool take_interrupt(bool poll)
+{
+    if (poll)
+        pump_events(0);
+    bool was = interrupt_pending;
+    interrupt_pending = false;
+    interrupted = false;
+    return was;
+}
+
+// ! le uma linha da entrada pelo loop; 1 = linha, 0 = fim, -1 = ctrl-c
+static int read_line_events(char *line, size_t size)
+{
+    while (1)
+    {
+        char *nl = memchr(inbuf, '\n', inlen);
+        if (nl != NULL || (stdin_eof && inlen > 0) || inlen == sizeof(inbuf))
+        {
+            size_t len = nl != NULL ? (size_t)(nl - inbuf) + 1 : inlen;
+            size_t copy = len < size - 1 ? len : size - 1;
+            memcpy(line, inbuf, copy);
+            line[copy] = '\0';
+            memmove(inbuf, inbuf + len, inlen - len);
+            inlen -= len;
+            return 1;
+        }
+
+        if (stdin_eof)
+            return 0;
+
+        if (stdin_polled && !stdin_ready)
+        {
+            struct epoll_event ev;
+            ev.events = EPOLLIN | EPOLLONESHOT;
+            ev.data.u64 = (uint64_t)EV_STDIN << 32;
+            epoll_ctl(epfd, EPOLL_CTL_MOD, STDIN_FILENO, &ev);
+
+            while (!stdin_ready && !interrupted)
+                pump_events(-1);
+
+            if (interrupted)
+            {
+                interrupted = false;
+                return -1;
+            }
+        }
+
+        ssize_t r = read(STDIN_FILENO, inbuf + inlen, sizeof(inbuf) - inlen);
+        stdin_ready = false;
+        if (r < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            perror("erro na leitura");
+            return 0;
+        }
+        if (r == 0)
+            stdin_eof = true;
+        inlen += (size_t)r;
+    }
+}
+
+int read_line(char *line, size_t size)
+{
+    TRACE('B', "read_line", NULL, NULL, 0, NULL, 0);
+    interrupt_pending = false; // um ctrl-c da linha anterior nao para o proximo laco
+    int got = read_line_events(line, size);
+    TRACE('E', "read_line", NULL, "got", got, "len", got > 0 ? strlen(line) : 0);
+    return got;
+}
+
+// ! le um arquivo pequeno do sysfs para buf, retorna false se nao existir
+static bool read_sysfs(const char *path, char *buf, size_t size)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+
+    bool ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    if (ok)
+        buf[strcspn(buf, "\n")] = '\0';
+    return ok;
+}
+
+// ! converte uma lista no formato do kernel ("0-3,8,10-11") em vetor de cpus
+int parse_cpu_list(const char *list, int *cpus, int max)
+{
+    int count = 0;
+    const char *p = list;
+
+    while (*p != '\0' && count < max)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE)
+            return -1;
+
+        long last = first;
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first || last >= CPU_SETSIZE)
+                return -1;
+        }
+
+        for (long c = first; c <= last && count < max; c++)
+            cpus[count++] = (int)c;
+
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return count;
+}
+
+// ! menor cpu que compartilha a cache do nivel pedido com cpu, serve de id da cache
+static int cache_id(int cpu, int level)
+{
+    char path[PATH_MAX];
+    char buf[256];
+    int shared[CPU_SETSIZE];
+
+    for (int idx = 0; idx < 8; idx++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, idx);
+        if (!read_sysfs(path, buf, sizeof(buf)))
+            break;
+        if (atoi(buf) != level)
+            continue;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, idx);
+        if (!read_sysfs(path, buf, sizeof(buf)))
+            break;
+        int n = parse_cpu_list(buf, shared, CPU_SETSIZE);
+        if (n > 0)
+            return shared[0];
+    }
+    return cpu; // sem informacao: cada cpu e o seu proprio grupo
+}
+
+// ! le a topologia (nos NUMA e caches compartilhadas) do sysfs, restrita
+// ! as cpus que a shell pode usar (taskset, cgroup cpuset)
+void init_topology(void)
+{
+    char path[PATH_MAX];
+    char buf[4096];
+    int usable[CPU_SETSIZE];
+    int key[CPU_SETSIZE][3]; // no, cache L3, cache L2 de cada cpu
+    int cpu_node[CPU_SETSIZE];
+    cpu_set_t allowed;
+    int n = 0;
+
+    topo.ncpus = 0;
+    topo.nnodes = 0;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        return;
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &allowed))
+            usable[n++] = c;
+    if (n == 0)
+        return;
+
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        cpu_node[c] = 0;
+
+    for (int node = 0; node < MAX_NODES; node++)
+    {
+        int cpus[CPU_SETSIZE];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (!read_sysfs(path, buf, sizeof(buf)))
+            continue;
+
+        int count = parse_cpu_list(buf, cpus, CPU_SETSIZE);
+        if (count <= 0)
+            continue;
+
+        // nos sem nenhuma cpu permitida ficam de fora do spread
+        CPU_ZERO(&topo.nodes[topo.nnodes]);
+        for (int i = 0; i < count; i++)
+        {
+            if (cpus[i] >= CPU_SETSIZE || !CPU_ISSET(cpus[i], &allowed))
+                continue;
+            CPU_SET(cpus[i], &topo.nodes[topo.nnodes]);
+            cpu_node[cpus[i]] = topo.nnodes;
+        }
+        if (CPU_COUNT(&topo.nodes[topo.nnodes]) > 0)
+            topo.nnodes++;
+    }
+
+    // ordena as cpus para que vizinhas na lista compartilhem cache
+    for (int i = 0; i < n; i++)
+    {
+        int c = usable[i];
+        int j = i;
+        key[c][0] = cpu_node[c];
+        key[c][1] = cache_id(c, 3);
+        key[c][2] = cache_id(c, 2);
+
+        while (j > 0)
+        {
+            int *a = key[topo.order[j - 1]];
+            if (a[0] < key[c][0]
+                || (a[0] == key[c][0] && (a[1] < key[c][1]
+                || (a[1] == key[c][1] && a[2] <= key[c][2]))))
+                break;
+            topo.order[j] = topo.order[j - 1];
+            j--;
+        }
+        topo.order[j] = c;
+    }
+    topo.ncpus = n;
+}
+
+// ! define a mascara de cpus do estagio stage da pipeline que esta sendo lancada
+void select_stage_cpus(int stage, int stage_count)
+{
+    Placement *place = current_place;
+    stage_pinned = false;
+    CPU_ZERO(&stage_cpus);
+
+    switch (place->mode)
+    {
+    case PLACE_COMPACT:
+        if (topo.ncpus == 0)
+            return;
+        CPU_SET(topo.order[(place_base + stage) % topo.ncpus], &stage_cpus);
+        stage_pinned = true;
+        // a proxima pipeline comeca nos cores seguintes
+        if (stage == stage_count - 1)
+            place_base = (place_base + stage_count) % topo.ncpus;
+        break;
+    case PLACE_SPREAD:
+        if (topo.nnodes == 0)
+            return;
+        stage_cpus = topo.nodes[spread_node];
+        stage_pinned = true;
+        // a pipeline inteira fica no mesmo no; a proxima vai para o seguinte
+        if (stage == stage_count - 1)
+            spread_node = (spread_node + 1) % topo.nnodes;
+        break;
+    case PLACE_LIST:
+        if (place->cpu_count == 0)
+            return;
+        CPU_SET(place->cpus[stage % place->cpu_count], &stage_cpus);
+        stage_pinned = true;
+        break;
+    default:
+        break;
+    }
+}
+
+// ! comando affinity: mostra ou altera a politica de posicionamento em place
+int builtin_affinity(char **args, Placement *place)
+{
+    if (args[1] == NULL)
+    {
+        const char *names[] = {"none", "compact", "spread", "list"};
+        printf("politica: %s\n", names[place->mode]);
+        printf("cpus: %d, nos NUMA: %d\n", topo.ncpus, topo.nnodes);
+        printf("ordem compacta:");
+        for (int i = 0; i < topo.ncpus; i++)
+            printf(" %d", topo.order[i]);
+        printf("\n");
+        return 0;
+    }
+
+    if (strcmp(args[1], "none") == 0 && args[2] == NULL)
+        place->mode = PLACE_NONE;
+    else if (strcmp(args[1], "compact") == 0 && args[2] == NULL)
+        place->mode = PLACE_COMPACT;
+    else if (strcmp(args[1], "spread") == 0 && args[2] == NULL)
+        place->mode = PLACE_SPREAD;
+    else if (strcmp(args[1], "list") == 0 && args[2] != NULL && args[3] == NULL)
+    {
+        int count = parse_cpu_list(args[2], place->cpus, CPU_SETSIZE);
+        if (count <= 0)
+        {
+            fprintf(stderr, "erro: lista de cpus invalida: %s\n", args[2]);
+            return -1;
+        }
+        place->cpu_count = count;
+        place->mode = PLACE_LIST;
+    }
+    else
+    {
+        fprintf(stderr, "uso: affinity [none|compact|spread|list <cpus>] [-- comando]\n");
+        return -1;
+    }
+    return 0;
+}
+
+// ! converte "1.5", "30s", "2m", "1h", "1d" em milissegundos; -1 se invalido
+static long parse_duration(const char *s)
+{
+    char *end;
+    double value = strtod(s, &end);
+    if (end == s || value < 0)
+        return -1;
+
+    double scale = 1000.0;
+    if (*end == 'm')
+        scale = 60 * 1000.0;
+    else if (*end == 'h')
+        scale = 3600 * 1000.0;
+    else if (*end == 'd')
+        scale = 86400 * 1000.0;
+    else if (*end != 's' && *end != '\0')
+        return -1;
+    if (*end != '\0' && end[1] != '\0')
+        return -1;
+
+    long ms = (long)(value * scale + 0.5);
+    return value > 0 && ms == 0 ? 1 : ms;
+}
+
+// ! le "DUR [--kill-after D]" a partir de args[i] em spec; retorna o indice
+// ! do primeiro argumento depois das opcoes ou -1 se algo for invalido
+static int parse_timeout_spec(char **args, int i, TimeoutSpec *spec)
+{
+    spec->term_ms = parse_duration(args[i]);
+    spec->kill_ms = TIMEOUT_KILL_AFTER_MS;
+    if (spec->term_ms < 0)
+        return -1;
+    i++;
+
+    if (args[i] != NULL && strcmp(args[i], "--kill-after") == 0)
+    {
+        if (args[i + 1] == NULL || (spec->kill_ms = parse_duration(args[i + 1])) < 0)
+            return -1;
+        i += 2;
+    }
+    else if (args[i] != NULL && strncmp(args[i], "--kill-after=", 13) == 0)
+    {
+        if ((spec->kill_ms = parse_duration(args[i] + 13)) < 0)
+            return -1;
+        i++;
+    }
+    return i;
+}
+
+// ! comando timeout: "timeout" mostra o padrao da sessao, "timeout default
+// ! off|DUR [--kill-after D]" altera o padrao, "timeout DUR [--kill-after D]
+// ! cmd | ..." preenche line e deixa em args so o comando (retorna 1)
+int builtin_timeout(char **args, TimeoutSpec *session, TimeoutSpec *line)
+{
+    if (args[1] == NULL)
+    {
+        if (session->term_ms == 0)
+            printf("timeout: off\n");
+        else
+            printf("timeout: %.3gs, SIGKILL %.3gs depois\n", session->term_ms / 1000.0, session->kill_ms / 1000.0);
+        return 0;
+    }
+
+    if (strcmp(args[1], "default") == 0)
+    {
+        TimeoutSpec spec = {0, 0};
+        if (args[2] != NULL && strcmp(args[2], "off") == 0 && args[3] == NULL)
+        {
+            *session = spec;
+            return 0;
+        }
+        if (args[2] != NULL)
+        {
+            int next = parse_timeout_spec(args, 2, &spec);
+            if (next > 0 && args[next] == NULL)
+            {
+                *session = spec;
+                return 0;
+            }
+        }
+    }
+    else
+    {
+        int next = parse_timeout_spec(args, 1, line);
+        if (next > 0 && args[next] != NULL)
+        {
+            int k = 0;
+            for (int j = next; args[j] != NULL; j++)
+                args[k++] = args[j];
+            args[k] = NULL;
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "uso: timeout [default off|DUR [--kill-after D]] | timeout DUR [--kill-after D] comando | ...\n");
+    return -1;
+}
+
+// ! tira de args o "watch [--on CAMINHO]... [--interval T] [--]"; 0 com o
+// ! comando que sobrou em args, -1 com uso errado
+int parse_watch(char **args, WatchSpec *spec)
+{
+    int i = 1;
+
+    spec->count = 0;
+    spec->interval_ms = -1;
+    for (; args[i] != NULL; i++)
+    {
+        if (strcmp(args[i], "--on") == 0 && args[i + 1] != NULL && spec->count < MAX_WATCH_PATHS)
+            spec->paths[spec->count++] = args[++i];
+        else if (strcmp(args[i], "--interval") == 0 && args[i + 1] != NULL &&
+                 (spec->interval_ms = parse_duration(args[i + 1])) >= 0)
+            i++;
+        else if (strcmp(args[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        else if (strncmp(args[i], "--", 2) == 0)
+            args[i] = NULL; // opcao desconhecida ou sem valor: cai no uso
+        else
+            break;
+        if (args[i] == NULL)
+            break;
+    }
+
+    if (args[i] == NULL)
+    {
+        fprintf(stderr, "uso: watch [--on CAMINHO]... [--interval T] [--] comando | ...\n");
+        return -1;
+    }
+    int k = 0;
+    for (int j = i; args[j] != NULL; j++)
+        args[k++] = args[j];
+    args[k] = NULL;
+    return 0;
+}
+
+// ! roda a pipeline uma vez guardando a saida em out, pelo execute_pipeline
+// ! (ou direto no buffer, para um builtin sozinho); retorna o status
+static int watch_capture(char *orig[MAX_STAGES][MAX_ARGS + 1], int stage_count, Buffer *out)
+{
+    char *stages[MAX_STAGES][MAX_ARGS + 1];
+    int fd[2];
+
+    // o execute_pipeline tira os redirecionamentos dos argv: cada volta usa uma copia
+    memcpy(stages, orig, sizeof(stages));
+    out->len = 0;
+    if (stage_count == 1 && is_builtin(stages[0][0]))
+    {
+        char *mem = NULL;
+        size_t mem_len = 0;
+        FILE *f = open_memstream(&mem, &mem_len);
+        if (f == NULL)
+            return 1;
+        int status = run_builtin(stages[0], f);
+        fclose(f);
+        buffer_append(out, mem, mem_len);
+        free(mem);
+        return status;
+    }
+
+    if (pipe2(fd, O_CLOEXEC) == -1)
+    {
+        perror("pipe error");
+        return 1;
+    }
+    int j = execute_pipeline(stages, stage_count, fd[1]);
+
+    while (1)
+    {
+        buffer_reserve(out, CAPTURE_CHUNK);
+        ssize_t r = read(fd[0], out->data + out->len, out->cap - out->len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        out->len += (size_t)r;
+    }
+    close(fd[0]);
+    return wait_job(j);
+}
+
+// ! imprime as linhas de text[from, to) com o prefixo; a ultima ganha '\n'
+static void print_lines(const char *prefix, const char *text, size_t from, size_t to)
+{
+    while (from < to)
+    {
+        const char *nl = memchr(text + from, '\n', to - from);
+        size_t end = nl != NULL ? (size_t)(nl - text) : to;
+        printf("%s%.*s\n", prefix, (int)(end - from), text + from);
+        from = end + 1;
+    }
+}
+
+// ! true se at e inicio de linha em b (pre ja e)
+static bool line_start(const Buffer *b, size_t pre, size_t at)
+{
+    return at == pre || b->data[at - 1] == '\n';
+}
+
+// ! mostra so o que mudou entre duas saidas: o trecho depois do maior prefixo
+// ! e antes do maior sufixo comuns, em linhas inteiras. Cobre o caso comum de
+// ! linhas acrescentadas, tiradas ou trocadas num lugar so, sem tabela de LCS
+static void print_changes(const Buffer *old, const Buffer *cur)
+{
+    size_t min = old->len < cur->len ? old->len : cur->len;
+    size_t pre = 0, suf = 0;
+
+    while (pre < min && old->data[pre] == cur->data[pre])
+        pre++;
+    if (pre == old->len && pre == cur->len)
+        return; // nada mudou, nada a mostrar
+    while (pre > 0 && old->data[pre - 1] != '\n')
+        pre--;
+
+    while (suf < min - pre && old->data[old->len - 1 - suf] == cur->data[cur->len - 1 - suf])
+        suf++;
+    // o sufixo tem que comecar numa linha nas duas saidas ("b" -> "xb" tambem)
+    while (suf > 0 && !(line_start(old, pre, old->len - suf) && line_start(cur, pre, cur->len - suf)))
+        suf--;
+
+    time_t now = time(NULL);
+    char stamp[16];
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&now));
+    printf("[watch %s]\n", stamp);
+    print_lines("- ", old->data, pre, old->len - suf);
+    print_lines("+ ", cur->data, pre, cur->len - suf);
+}
+
+// ! le todos os eventos pendentes; um caminho cujo watch sumiu (arquivo
+// ! trocado por rename, como os editores salvam) volta a ser observado
+static void drain_watch(int ifd, const WatchSpec *spec, int *wds)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+
+    while ((n = read(ifd, buf, sizeof(buf))) > 0)
+    {
+        for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len)
+        {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (!(ev->mask & IN_IGNORED))
+                continue;
+            for (int i = 0; i < spec->count; i++)
+                if (wds[i] == ev->wd)
+                    wds[i] = -1;
+        }
+    }
+    watch_ready = false;
+}
+
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                    IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+// ! tenta (de novo) observar os caminhos sem watch; retorna quantos estao ativos
+static int arm_watches(int ifd, const WatchSpec *spec, int *wds)
+{
+    int active = 0;
+    for (int i = 0; i < spec->count; i++)
+    {
+        if (wds[i] < 0)
+        {
+            char full[PATH_MAX];
+            const char *path = spec->paths[i];
+            if (exec_env != NULL && exec_env->cwd != NULL && path[0] != '/')
+            {
+                snprintf(full, sizeof(full), "%s/%s", exec_env->cwd, path);
+                path = full;
+            }
+            wds[i] = inotify_add_watch(ifd, path, WATCH_MASK);
+        }
+        active += wds[i] >= 0;
+    }
+    return active;
+}
+
+// ! espera ate deadline (monotonic_ns) processando eventos; retorna cedo
+// ! com ctrl-c ou, com stop_on_watch, no primeiro evento do inotify
+static void watch_sleep(uint64_t deadline, bool stop_on_watch)
+{
+    while (!interrupted && !(stop_on_watch && watch_ready))
+    {
+        uint64_t now = monotonic_ns();
+        if (now >= deadline)
+            return;
+        pump_events((int)((deadline - now) / 1000000) + 1);
+    }
+}
+
+int run_watch(const WatchSpec *spec, char *stages[MAX_STAGES][MAX_ARGS + 1], int stage_count)
+{
+    int wds[MAX_WATCH_PATHS];
+    int ifd = -1;
+    long interval = spec->interval_ms >= 0 ? spec->interval_ms : spec->count > 0 ? WATCH_DEBOUNCE_MS : WATCH_PERIOD_MS;
+    Buffer prev = {NULL, 0, 0};
+    Buffer cur = {NULL, 0, 0};
+
+    if (epfd < 0)
+    {
+        fprintf(stderr, "watch: so na shell interativa\n");
+        return 1;
+    }
+    if (spec->count > 0)
+    {
+        ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (ifd < 0)
+        {
+            perror("inotify");
+            return 1;
+        }
+        for (int i = 0; i < spec->count; i++)
+            wds[i] = -1;
+        if (arm_watches(ifd, spec, wds) < spec->count)
+        {
+            for (int i = 0; i < spec->count; i++)
+                if (wds[i] < 0)
+                    perror(spec->paths[i]);
+            close(ifd);
+            return 1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = (uint64_t)EV_WATCH << 32;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, ifd, &ev);
+    }
+
+    interrupted = false;
+    watch_ready = false;
+    int status = 0;
+    bool first = true;
+    while (!interrupted)
+    {
+        status = watch_capture(stages, stage_count, &cur);
+        if (first)
+            fwrite(cur.data, 1, cur.len, stdout);
+        else
+            print_changes(&prev, &cur);
+        fflush(stdout);
+        first = false;
+        Buffer swap = prev;
+        prev = cur;
+        cur = swap;
+
+        if (ifd < 0)
+        {
+            watch_sleep(monotonic_ns() + interval * 1000000ull, false);
+            continue;
+        }
+
+        // parado: so o epoll_wait, sem timer nem processo ate o inotify avisar.
+        // Eventos durante a execucao ja estao na fila e disparam a proxima
+        while (!watch_ready && !interrupted)
+            pump_events(-1);
+
+        // rajada: so roda quando passar interval sem evento novo
+        do
+        {
+            drain_watch(ifd, spec, wds);
+            watch_sleep(monotonic_ns() + interval * 1000000ull, true);
+        } while (watch_ready && !interrupted);
+
+        if (arm_watches(ifd, spec, wds) == 0)
+        {
+            fprintf(stderr, "watch: nenhum caminho restou para observar\n");
+            break;
+        }
+    }
+
+    interrupted = false; // o ctrl-c encerrou o watch, nao descarta a proxima linha
+    if (ifd >= 0)
+    {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, ifd, NULL);
+        close(ifd);
+    }
+    free(prev.data);
+    free(cur.data);
+    return status;
+}
@@ -0,0 +1,541 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "fileio.h"
+
+// raw syscalls, glibc has no wrappers for io_uring
+static int ring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ring_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int ring_register(int fd, unsigned op, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+// check that the kernel knows every opcode the engine uses
+static int ring_has_ops(int fd) {
+    static const int needed[] = {IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_STATX,
+                                 IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED};
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    if (!probe) return 0;
+    int ok = ring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED))
+            ok = 0;
+    }
+    free(probe);
+    return ok;
+}
+
+static void ring_unmap(struct fio *io) {
+    if (io->sqes && io->sqes != MAP_FAILED) munmap(io->sqes, io->sqes_len);
+    if (io->cq_ptr && io->cq_ptr != MAP_FAILED && io->cq_ptr != io->sq_ptr) munmap(io->cq_ptr, io->cq_len);
+    if (io->sq_ptr && io->sq_ptr != MAP_FAILED) munmap(io->sq_ptr, io->sq_len);
+    io->sqes = NULL; io->cq_ptr = NULL; io->sq_ptr = NULL;
+}
+
+int fio_init(struct fio *io) {
+    memset(io, 0, sizeof(*io));
+    io->ring_fd = -1;
+    io->buf = aligned_alloc(4096, (size_t)FIO_DEPTH * FIO_BUF_SIZE);
+    if (!io->buf) return -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = ring_setup(2 * FIO_DEPTH, &p);
+    if (fd < 0) return 0; // no io_uring here, stay on the blocking path
+
+    io->ring_fd = fd;
+    io->sq_entries = p.sq_entries;
+    io->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    io->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->cq_len > io->sq_len) io->sq_len = io->cq_len;
+        io->cq_len = io->sq_len;
+    }
+    io->sq_ptr = mmap(NULL, io->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        io->cq_ptr = io->sq_ptr;
+    else
+        io->cq_ptr = mmap(NULL, io->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    io->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = mmap(NULL, io->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    struct iovec iov[FIO_DEPTH];
+    for (int i = 0; i < FIO_DEPTH; i++) {
+        iov[i].iov_base = io->buf + (size_t)i * FIO_BUF_SIZE;
+        iov[i].iov_len = FIO_BUF_SIZE;
+    }
+    if (io->sq_ptr == MAP_FAILED || io->cq_ptr == MAP_FAILED || io->sqes == MAP_FAILED
+        || !(p.features & IORING_FEAT_RW_CUR_POS) || !ring_has_ops(fd)
+        || ring_register(fd, IORING_REGISTER_BUFFERS, iov, FIO_DEPTH) < 0) {
+        ring_unmap(io);
+        close(fd);
+        io->ring_fd = -1;
+        return 0;
+    }
+
+    char *sq = io->sq_ptr, *cq = io->cq_ptr;
+    io->sq_head = (unsigned *)(sq + p.sq_off.head);
+    io->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    io->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    io->sq_array = (unsigned *)(sq + p.sq_off.array);
+    io->cq_head = (unsigned *)(cq + p.cq_off.head);
+    io->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    io->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+void fio_exit(struct fio *io) {
+    if (io->ring_fd >= 0) {
+        ring_unmap(io);
+        close(io->ring_fd);
+    }
+    free(io->buf);
+    io->buf = NULL;
+    io->ring_fd = -1;
+}
+
+// hand queued sqes to the kernel and wait for at least wait completions
+static int ring_submit(struct fio *io, unsigned wait) {
+    while (io->to_submit > 0 || wait > 0) {
+        int r = ring_enter(io->ring_fd, io->to_submit, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        io->to_submit -= (unsigned)r;
+        break;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *get_sqe(struct fio *io) {
+    unsigned tail = *io->sq_tail;
+    if (tail - __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE) >= io->sq_entries) {
+        ring_submit(io, 0);
+        if (tail - __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE) >= io->sq_entries) return NULL;
+    }
+    unsigned idx = tail & *io->sq_mask;
+    struct io_uring_sqe *sqe = &io->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    io->sq_array[idx] = idx;
+    __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    io->to_submit++;
+    return sqe;
+}
+
+// submit everything queued and collect count completions into io->res
+static int ring_run(struct fio *io, unsigned count) {
+    unsigned done = 0;
+    while (done < count) {
+        if (ring_submit(io, count - done) < 0) return -1;
+        unsigned head = *io->cq_head;
+        while (head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &io->cqes[head & *io->cq_mask];
+            io->res[cqe->user_data] = cqe->res;
+            head++;
+            done++;
+        }
+        __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+static int queue_rw(struct fio *io, int op, int fd, int slot, unsigned len, unsigned long long off, unsigned long long data) {
+    struct io_uring_sqe *sqe = get_sqe(io);
+    if (!sqe) return -1;
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)(io->buf + (size_t)slot * FIO_BUF_SIZE);
+    sqe->len = len;
+    sqe->off = off;
+    sqe->buf_index = slot;
+    sqe->user_data = data;
+    return 0;
+}
+
+// write len bytes of a registered buffer to several fds; one submission per call
+static int write_slot(struct fio *io, int slot, size_t len, int *fds, int nfds) {
+    const char *data = io->buf + (size_t)slot * FIO_BUF_SIZE;
+    if (io->ring_fd < 0) {
+        int ret = 0;
+        for (int t = 0; t < nfds; t++) {
+            for (size_t off = 0; off < len; ) {
+                ssize_t w = write(fds[t], data + off, len - off);
+                if (w < 0) { if (errno == EINTR) continue; ret = -1; break; }
+                off += (size_t)w;
+            }
+        }
+        return ret;
+    }
+
+    for (int t = 0; t < nfds; t++)
+        if (queue_rw(io, IORING_OP_WRITE_FIXED, fds[t], slot, (unsigned)len, (unsigned long long)-1, 2 * FIO_DEPTH + t) < 0)
+            return -1;
+    if (ring_run(io, (unsigned)nfds) < 0) return -1;
+
+    int ret = 0;
+    for (int t = 0; t < nfds; t++) {
+        int w = io->res[2 * FIO_DEPTH + t];
+        if (w < 0) { ret = -1; continue; }
+        // short writes (pipes, full disks) finish on the blocking path
+        for (size_t off = (size_t)w; off < len; ) {
+            ssize_t r = write(fds[t], data + off, len - off);
+            if (r < 0) { if (errno == EINTR) continue; ret = -1; break; }
+            off += (size_t)r;
+        }
+    }
+    return ret;
+}
+
+// write the buffers in slots to fd in order, as one linked submission
+static int write_chain(struct fio *io, int *slots, int *len, int k, int fd) {
+    int ret = 0, first_bad = k;
+    if (k == 0) return 0;
+    if (io->ring_fd < 0) {
+        for (int i = 0; i < k; i++) {
+            if (write_slot(io, slots[i], (size_t)len[slots[i]], &fd, 1) < 0) ret = -1;
+            len[slots[i]] = 0;
+        }
+        return ret;
+    }
+
+    for (int i = 0; i < k; i++) {
+        if (queue_rw(io, IORING_OP_WRITE_FIXED, fd, slots[i], (unsigned)len[slots[i]], (unsigned long long)-1, slots[i]) < 0)
+            return -1;
+        if (i < k - 1) io->sqes[(*io->sq_tail - 1) & *io->sq_mask].flags |= IOSQE_IO_LINK;
+    }
+    if (ring_run(io, (unsigned)k) < 0) return -1;
+
+    // a short write breaks the link and cancels the rest, finish those in order
+    for (int i = 0; i < k && first_bad == k; i++)
+        if (io->res[slots[i]] != len[slots[i]]) first_bad = i;
+    for (int i = first_bad; i < k; i++) {
+        int done = i == first_bad && io->res[slots[i]] > 0 ? io->res[slots[i]] : 0;
+        const char *data = io->buf + (size_t)slots[i] * FIO_BUF_SIZE;
+        for (size_t off = (size_t)done; off < (size_t)len[slots[i]]; ) {
+            ssize_t w = write(fd, data + off, (size_t)len[slots[i]] - off);
+            if (w < 0) { if (errno == EINTR) continue; ret = -1; break; }
+            off += (size_t)w;
+        }
+    }
+    for (int i = 0; i < k; i++) len[slots[i]] = 0;
+    return ret;
+}
+
+int fio_open_many(struct fio *io, char **paths, int count, int flags, mode_t mode, int *fds) {
+    int opened = 0;
+    for (int base = 0; base < count; base += FIO_DEPTH) {
+        int n = count - base < FIO_DEPTH ? count - base : FIO_DEPTH;
+        if (io->ring_fd < 0) {
+            for (int i = 0; i < n; i++) io->res[i] = open(paths[base + i], flags, mode);
+        } else {
+            for (int i = 0; i < n; i++) {
+                struct io_uring_sqe *sqe = get_sqe(io);
+                if (!sqe) return -1;
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = (unsigned long long)(uintptr_t)paths[base + i];
+                sqe->len = mode;
+                sqe->open_flags = (unsigned)flags;
+                sqe->user_data = (unsigned long long)i;
+            }
+            if (ring_run(io, (unsigned)n) < 0) return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            fds[base + i] = io->res[i] >= 0 ? io->res[i] : -1;
+            if (fds[base + i] >= 0) opened++;
+        }
+    }
+    return opened;
+}
+
+// close n fds, queued together so a batch costs one submission
+static void close_many(struct fio *io, int *fds, int n) {
+    int queued = 0;
+    for (int i = 0; i < n; i++) {
+        if (fds[i] < 0) continue;
+        struct io_uring_sqe *sqe = io->ring_fd >= 0 ? get_sqe(io) : NULL;
+        if (!sqe) { close(fds[i]); continue; }
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = fds[i];
+        sqe->user_data = (unsigned long long)(FIO_DEPTH + i);
+        queued++;
+    }
+    if (queued) ring_run(io, (unsigned)queued);
+}
+
+int fio_cat(struct fio *io, char **paths, int count, int out_fd) {
+    int ret = 0;
+
+    for (int base = 0; base < count; base += FIO_DEPTH) {
+        int n = count - base < FIO_DEPTH ? count - base : FIO_DEPTH;
+        int fds[FIO_DEPTH];
+        long long pos[FIO_DEPTH];
+        int len[FIO_DEPTH];
+        int eof[FIO_DEPTH];
+        int stream[FIO_DEPTH]; // pipe, fifo or tty: no offsets, plain read()
+
+        if (fio_open_many(io, paths + base, n, O_RDONLY, 0, fds) < 0) return -1;
+        for (int i = 0; i < n; i++) {
+            pos[i] = 0;
+            stream[i] = 0;
+            eof[i] = fds[i] < 0;
+            if (fds[i] < 0) ret = -1;
+        }
+
+        for (int i = 0; i < n; i++) len[i] = 0;
+
+        // each round reads one buffer for every file whose buffer is free, then
+        // flushes in file order. Only a read of 0 is end of file: a pipe or a
+        // fifo hands out short reads while the writer is still there, so a
+        // batch of small files costs two read rounds (data, then 0)
+        for (int cur = 0; cur < n; ) {
+            int queued = 0;
+            for (int i = cur; i < n; i++) {
+                if (eof[i] || len[i] > 0) continue;
+                if (io->ring_fd < 0) {
+                    char *dst = io->buf + (size_t)i * FIO_BUF_SIZE;
+                    ssize_t r = stream[i] ? read(fds[i], dst, FIO_BUF_SIZE) : pread(fds[i], dst, FIO_BUF_SIZE, pos[i]);
+                    io->res[i] = r < 0 ? -errno : (int)r;
+                } else if (queue_rw(io, IORING_OP_READ_FIXED, fds[i], i, FIO_BUF_SIZE,
+                                    stream[i] ? ~0ull : (unsigned long long)pos[i], i) < 0) {
+                    return -1;
+                }
+                queued++;
+                len[i] = -1; // read in flight
+            }
+            if (io->ring_fd >= 0 && queued && ring_run(io, (unsigned)queued) < 0) return -1;
+
+            for (int i = cur; i < n; i++) {
+                if (len[i] != -1) continue;
+                int r = io->res[i];
+                len[i] = r > 0 ? r : 0;
+                if (r == -ESPIPE && !stream[i]) {
+                    stream[i] = 1; // not seekable: read it again from the current position
+                    continue;
+                }
+                if (r < 0) ret = -1;
+                if (r > 0) pos[i] += r;
+                else eof[i] = 1;
+            }
+
+            // later files keep their chunk until every file before them is written
+            int slots[FIO_DEPTH], k = 0;
+            while (cur < n) {
+                if (len[cur] > 0) slots[k++] = cur;
+                if (!eof[cur]) break;
+                cur++;
+            }
+            if (write_chain(io, slots, len, k, out_fd) < 0) ret = -1;
+        }
+        close_many(io, fds, n);
+    }
+    return ret;
+}
+
+int fio_stat_many(struct fio *io, char **names, int count, struct stat *st, int *ok) {
+    for (int base = 0; base < count; base += FIO_DEPTH) {
+        int n = count - base < FIO_DEPTH ? count - base : FIO_DEPTH;
+        struct statx stx[FIO_DEPTH];
+
+        if (io->ring_fd < 0) {
+            for (int i = 0; i < n; i++) ok[base + i] = stat(names[base + i], &st[base + i]) == 0;
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            struct io_uring_sqe *sqe = get_sqe(io);
+            if (!sqe) return -1;
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long long)(uintptr_t)names[base + i];
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = (unsigned long long)(uintptr_t)&stx[i];
+            sqe->user_data = (unsigned long long)i;
+        }
+        if (ring_run(io, (unsigned)n) < 0) return -1;
+        for (int i = 0; i < n; i++) {
+            ok[base + i] = io->res[i] == 0;
+            if (!ok[base + i]) continue;
+            memset(&st[base + i], 0, sizeof(struct stat));
+            st[base + i].st_mode = stx[i].stx_mode;
+            st[base + i].st_size = (off_t)stx[i].stx_size;
+            st[base + i].st_nlink = stx[i].stx_nlink;
+            st[base + i].st_uid = stx[i].stx_uid;
+            st[base + i].st_gid = stx[i].stx_gid;
+        }
+    }
+    return 0;
+}
+
+int fio_fanout(struct fio *io, int in_fd, int *fds, int nfds) {
+    int ret = 0;
+    if (nfds > FIO_MAX_TARGETS) return -1;
+    while (1) {
+        int r;
+        if (io->ring_fd < 0) {
+            ssize_t n = read(in_fd, io->buf, FIO_BUF_SIZE);
+            r = n < 0 ? -errno : (int)n;
+        } else {
+            if (queue_rw(io, IORING_OP_READ_FIXED, in_fd, 0, FIO_BUF_SIZE, (unsigned long long)-1, 0) < 0
+                || ring_run(io, 1) < 0)
+                return -1;
+            r = io->res[0];
+        }
+        if (r == -EINTR) continue;
+        if (r <= 0) return r < 0 ? -1 : ret;
+        if (write_slot(io, 0, (size_t)r, fds, nfds) < 0) ret = -1;
+    }
+}
+
+static int is_pipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    for (size_t off = 0; off < len; ) {
+        ssize_t w = write(fd, data + off, len - off);
+        if (w < 0) { if (errno == EINTR) continue; return -1; }
+        off += (size_t)w;
+    }
+    return 0;
+}
+
+// move len bytes from a scratch pipe to fd; splice while fd accepts it
+// (O_APPEND files and some devices don't), read/write after that
+static int drain_scratch(int scratch, int fd, size_t len, int *spliceable, char *buf) {
+    while (len > 0) {
+        ssize_t n = -1;
+        if (*spliceable) {
+            n = splice(scratch, NULL, fd, NULL, len, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno != EINVAL) return -1;
+            if (n < 0) *spliceable = 0;
+        }
+        if (n < 0) {
+            n = read(scratch, buf, len < FIO_BUF_SIZE ? len : FIO_BUF_SIZE);
+            if (n <= 0 || write_all(fd, buf, (size_t)n) < 0) return -1;
+        }
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Each round tee(2)s up to FIO_SPLICE_ROUND bytes of in_fd into every pipe target
+// and into a scratch pipe per file target (spliced into the file), then the
+// consumer target takes the bytes out of in_fd with splice(2). Only a short
+// tee or a target splice refuses sends a round through the user space buffer.
+int fio_splice_fanout(struct fio *io, int in_fd, int *fds, int nfds) {
+    int scratch[FIO_MAX_TARGETS][2], target_pipe[FIO_MAX_TARGETS];
+    int spliceable[FIO_MAX_TARGETS], live[FIO_MAX_TARGETS];
+    size_t got[FIO_MAX_TARGETS];
+    // a round fits in the first buffers, drain_scratch bounces through the next one
+    char *buf = io->buf, *spare = io->buf + FIO_SPLICE_ROUND;
+    int ret = 0, nlive = nfds;
+
+    if (nfds > FIO_MAX_TARGETS) return -1;
+    if (!is_pipe(in_fd)) return fio_fanout(io, in_fd, fds, nfds);
+
+    // the consumer needs no copy of its own: prefer a file, pipes tee for free
+    int consumer = nfds - 1;
+    for (int t = 0; t < nfds; t++) {
+        target_pipe[t] = is_pipe(fds[t]);
+        if (!target_pipe[t]) consumer = t;
+    }
+    // bigger rounds mean fewer syscalls per byte; best effort, limited by pipe-max-size
+    fcntl(in_fd, F_SETPIPE_SZ, FIO_SPLICE_ROUND);
+    int pipe_size = fcntl(in_fd, F_GETPIPE_SZ);
+    for (int t = 0; t < nfds; t++) {
+        scratch[t][0] = scratch[t][1] = -1;
+        spliceable[t] = 1;
+        live[t] = 1;
+        if (t == consumer || target_pipe[t]) continue;
+        // as big as in_fd, so a tee into the empty scratch is never short
+        if (pipe2(scratch[t], O_CLOEXEC) < 0
+            || (pipe_size > 0 && fcntl(scratch[t][1], F_SETPIPE_SZ, pipe_size) < pipe_size))
+            spliceable[t] = 0;
+    }
+
+    while (nlive > 0) {
+        struct pollfd p = { in_fd, POLLIN, 0 };
+        int avail = 0;
+        if (poll(&p, 1, -1) < 0) { if (errno == EINTR) continue; ret = -1; break; }
+        if (ioctl(in_fd, FIONREAD, &avail) < 0) { ret = -1; break; }
+        if (avail <= 0) break; // hung up with nothing left
+        size_t len = avail < FIO_SPLICE_ROUND ? (size_t)avail : FIO_SPLICE_ROUND;
+
+        int buffered = !live[consumer] || !spliceable[consumer];
+        for (int t = 0; t < nfds; t++) {
+            got[t] = 0;
+            if (t == consumer || !live[t]) continue;
+            if (!spliceable[t]) { buffered = 1; continue; }
+            ssize_t n;
+            do n = tee(in_fd, target_pipe[t] ? fds[t] : scratch[t][1], len, 0);
+            while (n < 0 && errno == EINTR);
+            if (n < 0 && errno == EPIPE) { live[t] = 0; nlive--; continue; }
+            if (n < 0) { spliceable[t] = 0; n = 0; }
+            got[t] = (size_t)n;
+            if (got[t] < len) buffered = 1;
+            if (!target_pipe[t] && n > 0 && drain_scratch(scratch[t][0], fds[t], got[t], &spliceable[t], spare) < 0) {
+                live[t] = 0; nlive--; ret = -1;
+            }
+        }
+
+        size_t base = 0;
+        if (!buffered) {
+            while (base < len) {
+                ssize_t n = splice(in_fd, NULL, fds[consumer], NULL, len - base, SPLICE_F_MOVE);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                base += (size_t)n;
+            }
+            if (base == len) continue;
+            if (base == 0 && errno == EINVAL) spliceable[consumer] = 0;
+            else { if (errno != EPIPE) ret = -1; live[consumer] = 0; nlive--; }
+        }
+
+        // the rest of the round goes through buf; nothing else reads in_fd
+        size_t have = 0;
+        while (have < len - base) {
+            ssize_t n = read(in_fd, buf + have, len - base - have);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            have += (size_t)n;
+        }
+        if (live[consumer] && write_all(fds[consumer], buf, have) < 0) {
+            if (errno != EPIPE) ret = -1;
+            live[consumer] = 0; nlive--;
+        }
+        for (int t = 0; t < nfds; t++) {
+            if (t == consumer || !live[t] || got[t] >= len) continue;
+            if (write_all(fds[t], buf + got[t], have - got[t]) < 0) {
+                if (errno != EPIPE) ret = -1;
+                live[t] = 0; nlive--;
+            }
+        }
+    }
+
+    for (int t = 0; t < nfds; t++) {
+        if (scratch[t][0] >= 0) close(scratch[t][0]);
+        if (scratch[t][1] >= 0) close(scratch[t][1]);
+    }
+    return ret;
+}
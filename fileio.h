@@ -0,0 +1,43 @@
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <linux/io_uring.h>
+
+#define FIO_DEPTH 32         // requests kept in flight per batch
+#define FIO_BUF_SIZE 65536   // size of each registered buffer
+#define FIO_MAX_TARGETS 64   // max fds a single fio_fanout call writes to
+#define FIO_SPLICE_ROUND (16 * FIO_BUF_SIZE) // bytes fio_splice_fanout moves per round
+
+// io_uring based file engine; ring_fd == -1 means the blocking fallback is used
+struct fio {
+    int ring_fd;
+    unsigned sq_entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned to_submit;          // queued sqes not yet handed to the kernel
+    int res[2 * FIO_DEPTH + FIO_MAX_TARGETS]; // completion results indexed by user_data
+    char *buf;                   // FIO_DEPTH buffers of FIO_BUF_SIZE, registered with the ring
+};
+
+int fio_init(struct fio *io);
+void fio_exit(struct fio *io);
+
+// open count paths, fds[i] is -1 for the ones that failed; returns number opened
+int fio_open_many(struct fio *io, char **paths, int count, int flags, mode_t mode, int *fds);
+// copy every file in paths to out_fd in order; returns -1 if any file failed
+int fio_cat(struct fio *io, char **paths, int count, int out_fd);
+// stat count names relative to cwd, ok[i] is 0 for the ones that failed
+int fio_stat_many(struct fio *io, char **names, int count, struct stat *st, int *ok);
+// copy in_fd to every fd in fds until EOF
+int fio_fanout(struct fio *io, int in_fd, int *fds, int nfds);
+// same, without copying through user space when in_fd is a pipe (tee/splice);
+// targets that hang up are dropped, so callers should ignore SIGPIPE
+int fio_splice_fanout(struct fio *io, int in_fd, int *fds, int nfds);
+
+#endif
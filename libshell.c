@@ -0,0 +1,350 @@
+#define _GNU_SOURCE
+#include "shell.h"
+#include "libshell.h"
+
+struct sh_ctx
+{
+    PathCache cache;
+    char **vars; // "NOME=valor", termina em NULL
+    int nvars;
+    int cap;
+    char cwd[PATH_MAX];
+    ExecEnv env;
+};
+
+sh_ctx *sh_ctx_new(void)
+{
+    static bool ready = false;
+    if (!ready)
+    {
+        trace_from_env();
+        init_events(false);
+        ready = true;
+    }
+
+    sh_ctx *ctx = calloc(1, sizeof(sh_ctx));
+    if (ctx == NULL)
+        return NULL;
+
+    ctx->cap = 16;
+    ctx->vars = calloc(ctx->cap + 1, sizeof(char *));
+    if (ctx->vars == NULL || getcwd(ctx->cwd, sizeof(ctx->cwd)) == NULL)
+    {
+        free(ctx->vars);
+        free(ctx);
+        return NULL;
+    }
+    ctx->env.cache = &ctx->cache;
+    ctx->env.err_fd = -1;
+    ctx->env.in_fd = -1;
+    return ctx;
+}
+
+void sh_ctx_free(sh_ctx *ctx)
+{
+    if (ctx == NULL)
+        return;
+    path_cache_clear(&ctx->cache);
+    for (int i = 0; i < ctx->nvars; i++)
+        free(ctx->vars[i]);
+    free(ctx->vars);
+    free(ctx);
+}
+
+// ! indice da variavel name em ctx->vars ou -1
+static int find_var(sh_ctx *ctx, const char *name)
+{
+    size_t len = strlen(name);
+    for (int i = 0; i < ctx->nvars; i++)
+        if (strncmp(ctx->vars[i], name, len) == 0 && ctx->vars[i][len] == '=')
+            return i;
+    return -1;
+}
+
+int sh_setvar(sh_ctx *ctx, const char *name, const char *value)
+{
+    if (name[0] == '\0' || strchr(name, '=') != NULL)
+        return -1;
+
+    int i = find_var(ctx, name);
+    if (value == NULL)
+    {
+        if (i < 0)
+            return 0;
+        free(ctx->vars[i]);
+        ctx->vars[i] = ctx->vars[--ctx->nvars];
+        ctx->vars[ctx->nvars] = NULL;
+        return 0;
+    }
+
+    char *entry = malloc(strlen(name) + strlen(value) + 2);
+    if (entry == NULL)
+        return -1;
+    sprintf(entry, "%s=%s", name, value);
+
+    if (i >= 0)
+    {
+        free(ctx->vars[i]);
+        ctx->vars[i] = entry;
+        return 0;
+    }
+
+    if (ctx->nvars == ctx->cap)
+    {
+        char **grown = realloc(ctx->vars, (ctx->cap * 2 + 1) * sizeof(char *));
+        if (grown == NULL)
+        {
+            free(entry);
+            return -1;
+        }
+        ctx->vars = grown;
+        ctx->cap *= 2;
+    }
+    ctx->vars[ctx->nvars++] = entry;
+    ctx->vars[ctx->nvars] = NULL;
+    return 0;
+}
+
+const char *sh_getvar(sh_ctx *ctx, const char *name)
+{
+    int i = find_var(ctx, name);
+    return i < 0 ? NULL : ctx->vars[i] + strlen(name) + 1;
+}
+
+const char *sh_cwd(sh_ctx *ctx)
+{
+    return ctx->cwd;
+}
+
+// ! cd no contexto: muda ctx->cwd, nao o diretorio do processo
+static int ctx_cd(sh_ctx *ctx, char **args)
+{
+    char full[PATH_MAX * 2];
+    char resolved[PATH_MAX];
+    struct stat st;
+
+    if (args[1] == NULL || args[2] != NULL)
+        return 1;
+    if (args[1][0] == '/')
+        snprintf(full, sizeof(full), "%s", args[1]);
+    else
+        snprintf(full, sizeof(full), "%s/%s", ctx->cwd, args[1]);
+    if (realpath(full, resolved) == NULL || stat(resolved, &st) != 0 || !S_ISDIR(st.st_mode))
+        return 1;
+    snprintf(ctx->cwd, sizeof(ctx->cwd), "%s", resolved);
+    return 0;
+}
+
+// ! builtins no contexto: cd e pwd usam o cwd do contexto, nao o do processo.
+// ! Com redirecao a saida vai para os destinos, como no shell.c; sem ela vai
+// ! para out, ou para o stdout quando out e NULL
+static int ctx_builtin(sh_ctx *ctx, char **args, Buffer *out)
+{
+    pid_t fanout;
+    int fd = redirect_outputs(args, STDOUT_FILENO, &fanout);
+    if (fd < 0)
+        return 1;
+
+    char *mem = NULL;
+    size_t mem_len = 0;
+    FILE *f;
+    if (fd != STDOUT_FILENO)
+        f = fdopen(fd, "w");
+    else if (out != NULL)
+        f = open_memstream(&mem, &mem_len);
+    else
+        f = stdout;
+    if (f == NULL)
+    {
+        if (fd != STDOUT_FILENO)
+            close(fd);
+        if (fanout > 0)
+            waitpid(fanout, NULL, 0);
+        return 1;
+    }
+
+    int status;
+    if (strcmp(args[0], "cd") == 0)
+    {
+        status = ctx_cd(ctx, args);
+    }
+    else if (strcmp(args[0], "pwd") == 0)
+    {
+        fprintf(f, "%s\n", ctx->cwd);
+        status = 0;
+    }
+    else
+    {
+        status = run_builtin(args, f);
+    }
+
+    if (f == stdout)
+        fflush(stdout);
+    else
+        fclose(f);
+    if (mem != NULL)
+    {
+        buffer_append(out, mem, mem_len);
+        free(mem);
+    }
+    if (fanout > 0)
+        waitpid(fanout, NULL, 0); // os destinos so estao completos quando o fanout sai
+    return status;
+}
+
+// ! le os pipes de captura ate o EOF dos dois
+static void drain(int out_fd, Buffer *out, int err_fd, Buffer *err)
+{
+    struct pollfd fds[2] = {{out_fd, POLLIN, 0}, {err_fd, POLLIN, 0}};
+    Buffer *bufs[2] = {out, err};
+
+    while (fds[0].fd >= 0 || fds[1].fd >= 0)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (fds[i].fd < 0 || fds[i].revents == 0)
+                continue;
+
+            buffer_reserve(bufs[i], CAPTURE_CHUNK);
+            ssize_t r = read(fds[i].fd, bufs[i]->data + bufs[i]->len, bufs[i]->cap - bufs[i]->len);
+            if (r > 0)
+                bufs[i]->len += (size_t)r;
+            else if (r == 0 || errno != EINTR)
+            {
+                close(fds[i].fd);
+                fds[i].fd = -1; // poll ignora fds negativos
+            }
+        }
+    }
+}
+
+// ! proxima linha do texto depois do comando, para os corpos de "<<FIM"
+static int text_line(char *buf, size_t size, void *ctx)
+{
+    char **rest = ctx;
+    if (*rest == NULL || **rest == '\0')
+        return 0;
+
+    size_t len = strcspn(*rest, "\n");
+    len += (*rest)[len] == '\n';
+    if (len > size - 1)
+        len = size - 1; // linha longa sai em pedacos
+    memcpy(buf, *rest, len);
+    buf[len] = '\0';
+    *rest += len;
+    return 1;
+}
+
+int sh_eval_capture(sh_ctx *ctx, const char *line, sh_buf *out, sh_buf *err)
+{
+    char *copy = strdup(line);
+    char *procs_args[MAX_PROCS][MAX_ARGS + 1];
+    char *stages[MAX_STAGES][MAX_ARGS + 1];
+    int results[MAX_PROCS]; // indice do job, ou -2 - status de um builtin
+    int out_pipe[2] = {-1, -1};
+    int err_pipe[2] = {-1, -1};
+    Buffer ob = {NULL, 0, 0};
+    Buffer eb = {NULL, 0, 0};
+    ExecEnv *saved = exec_env;
+
+    if (copy == NULL)
+        return -1;
+
+    // a primeira linha e o comando; as seguintes so servem de corpo de here-doc
+    char *rest = strchr(copy, '\n');
+    if (rest != NULL)
+        *rest++ = '\0';
+    // uma falha aqui ja pode ter aberto os here-docs: todas saem pelo mesmo caminho
+    if (read_heredocs(copy, text_line, &rest) < 0
+        || (out != NULL && pipe2(out_pipe, O_CLOEXEC) < 0)
+        || (err != NULL && pipe2(err_pipe, O_CLOEXEC) < 0))
+    {
+        if (out_pipe[0] >= 0)
+        {
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+        }
+        free_line_allocs();
+        free(copy);
+        return -1;
+    }
+    if (out != NULL)
+        ob = (Buffer){out->data, out->len, out->cap};
+    if (err != NULL)
+        eb = (Buffer){err->data, err->len, err->cap};
+
+    ctx->env.vars = ctx->vars;
+    ctx->env.cwd = ctx->cwd;
+    ctx->env.err_fd = err_pipe[1];
+    exec_env = &ctx->env;
+
+    int procs = simultaneos_proc(copy, procs_args);
+    for (int p = 0; p < procs; p++)
+    {
+        int count = split_pipeline_args(procs_args[p], stages);
+        results[p] = -2 - 1;
+        if (expand_substitutions(stages, count) < 0 || stages[0][0] == NULL)
+            continue;
+
+        if (count == 1 && is_builtin(stages[0][0]))
+        {
+            results[p] = -2 - ctx_builtin(ctx, stages[0], out != NULL ? &ob : NULL);
+            continue;
+        }
+
+        // execute_pipeline fecha o fd de saida que recebe
+        int fd = out != NULL ? dup(out_pipe[1]) : STDOUT_FILENO;
+        results[p] = fd < 0 ? -2 - 1 : execute_pipeline(stages, count, fd);
+        if (results[p] == -1)
+            results[p] = -2 - 1;
+    }
+
+    if (out != NULL)
+        close(out_pipe[1]);
+    if (err != NULL)
+        close(err_pipe[1]);
+    if (out != NULL || err != NULL)
+        drain(out_pipe[0], &ob, err_pipe[0], &eb);
+
+    int status = 0;
+    for (int p = 0; p < procs; p++)
+        status = results[p] >= 0 ? wait_job(results[p]) : -2 - results[p];
+
+    free_line_allocs();
+    free(copy);
+    exec_env = saved;
+
+    if (out != NULL)
+    {
+        buffer_reserve(&ob, 1);
+        ob.data[ob.len] = '\0';
+        *out = (sh_buf){ob.data, ob.len, ob.cap};
+    }
+    if (err != NULL)
+    {
+        buffer_reserve(&eb, 1);
+        eb.data[eb.len] = '\0';
+        *err = (sh_buf){eb.data, eb.len, eb.cap};
+    }
+    return status;
+}
+
+int sh_eval(sh_ctx *ctx, const char *line)
+{
+    return sh_eval_capture(ctx, line, NULL, NULL);
+}
+
+void sh_buf_free(sh_buf *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef LIBSHELL_H
+#define LIBSHELL_H
+
+// API para rodar pipelines da shell dentro de outro processo, sem /bin/sh.
+// build:
+//   gcc -c -fPIC core.c parser.c fileio.c textscan.c trace.c libshell.c
+//   ar rcs libshell.a core.o parser.o fileio.o textscan.o trace.o libshell.o
+//   gcc -shared -o libshell.so core.o parser.o fileio.o textscan.o trace.o libshell.o
+//
+// Um contexto guarda diretorio, variaveis e cache de caminhos entre chamadas.
+// As chamadas nao sao thread-safe: use um contexto por vez por processo.
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sh_ctx sh_ctx;
+
+// buffer de captura; cresce sozinho, liberar com sh_buf_free
+typedef struct
+{
+    char *data; // sempre terminado em '\0' depois de um sh_eval_capture
+    size_t len;
+    size_t cap;
+} sh_buf;
+
+sh_ctx *sh_ctx_new(void);
+void sh_ctx_free(sh_ctx *ctx);
+
+// variavel exportada para os comandos do contexto; value NULL remove
+int sh_setvar(sh_ctx *ctx, const char *name, const char *value);
+const char *sh_getvar(sh_ctx *ctx, const char *name);
+
+// diretorio de trabalho do contexto (o do processo nao muda)
+const char *sh_cwd(sh_ctx *ctx);
+
+// roda uma linha ("a | b > f & c"); retorna o status da ultima pipeline.
+// Depois da primeira linha vem so o corpo dos here-docs: "cat <<FIM\n...\nFIM"
+int sh_eval(sh_ctx *ctx, const char *line);
+
+// igual ao sh_eval, acrescentando stdout/stderr dos comandos em out/err;
+// NULL herda o fd do processo
+int sh_eval_capture(sh_ctx *ctx, const char *line, sh_buf *out, sh_buf *err);
+
+void sh_buf_free(sh_buf *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
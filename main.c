@@ -6,10 +6,11 @@
 #include <stdbool.h>
 #include <linux/limits.h>
 #include <sys/utsname.h>
+#include "parser.h"
+
+// build: gcc -o main main.c parser.c trace.c
 
 #define LSH_RL_BUFSIZE 1024
-#define LSH_TOK_BUFSIZE 64
-#define LSH_TOK_DELIM " \t\r\n\a"
 
 typedef struct
 {
@@ -52,7 +53,6 @@ const char *find_option(const char *key, const Option *options);
 const CommandFlags *find_command(const char *command, const CommandFlags *commands);
 
 char *lsh_read_line(void);
-char **lsh_split_line(char *line);
 void header();
 void small_header();
 void help();
@@ -202,41 +202,6 @@ void header()
     printf(" ╚═════╝╚═╝  ╚═╝╚═╝  ╚═╝╚══════╝╚═╝  ╚═╝\n");
 }
 
-char **lsh_split_line(char *line)
-{
-    int bufsize = LSH_TOK_BUFSIZE, position = 0;
-    char **tokens = malloc(bufsize * sizeof(char *));
-    char *token;
-
-    if (!tokens)
-    {
-        fprintf(stderr, "crash: allocation error\n");
-        exit(EXIT_FAILURE);
-    }
-
-    token = strtok(line, LSH_TOK_DELIM);
-    while (token != NULL)
-    {
-        tokens[position] = token;
-        position++;
-
-        if (position >= bufsize)
-        {
-            bufsize += LSH_TOK_BUFSIZE;
-            tokens = realloc(tokens, bufsize * sizeof(char *));
-            if (!tokens)
-            {
-                fprintf(stderr, "crash: allocation error\n");
-                exit(EXIT_FAILURE);
-            }
-        }
-
-        token = strtok(NULL, LSH_TOK_DELIM);
-    }
-    tokens[position] = NULL;
-    return tokens;
-}
-
 char *lsh_read_line(void)
 {
     char *line = NULL;
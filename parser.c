@@ -0,0 +1,525 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "parser.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PARSER_X86 1
+#endif
+
+#define SCAN_BLOCK 64 // bytes classificados de uma vez (uma mascara de 64 bits por classe)
+
+// classes de byte do classificador; cada uma vira uma mascara por bloco
+enum
+{
+    CLS_BLANK,   // ' ' e '\t'
+    CLS_NEWLINE, // '\n'
+    CLS_CTRL,    // '\r' e '\a', separadores so do lsh_split_line
+    CLS_PIPE,    // '|'
+    CLS_AMP,     // '&'
+    CLS_GT,      // '>'
+    CLS_LT,      // '<'
+    CLS_QUOTE,   // '\'', '"' e '`'
+    CLS_DOLLAR,  // '$'
+    CLS_NUL,     // '\0', fim da linha
+    CLS_COUNT
+};
+
+#define CLS(c) (1u << (c))
+
+// bytes de cada classe (CLS_NUL e marcado a parte, em toda linha)
+static const char class_bytes[CLS_COUNT][4] = {" \t", "\n", "\r\a", "|", "&", ">", "<", "'\"`", "$", ""};
+
+// cursor do tokenizador: o ultimo bloco alinhado classificado fica guardado,
+// entao os tokens de um mesmo bloco saem so de operacoes nas mascaras. Cada
+// tokenizador pede so as classes que usa: separadores e bytes especiais
+typedef struct
+{
+    const char *base;
+    unsigned sets[2]; // [0] separadores, [1] especiais ($ e aspas)
+    uint64_t mask[2]; // bit i: base[i] pertence a sets[0] / sets[1]
+    uint64_t nul;     // bit i: base[i] == '\0'
+    int lo, hi;       // base[lo..hi] classificados; fora disso as mascaras nao valem
+} Scan;
+
+#define SCAN_INIT(delim, special) {NULL, {(delim), (special)}, {0, 0}, 0, 0, -1}
+
+// ---- classificador: uma passada por bloco, sem ramificar por byte ----
+
+// ! le so os bytes da string: de block[from] ate o primeiro '\0' ou o fim do
+// ! bloco, o que vier antes; retorna o indice do ultimo byte classificado
+static int classify_scalar(const char *block, int from, const unsigned *sets, uint64_t *mask, uint64_t *nul)
+{
+    unsigned char cls[256] = {0}; // byte -> bits das mascaras que o contem
+    for (int g = 0; g < 2; g++)
+        for (unsigned rest = sets[g]; rest != 0; rest &= rest - 1)
+            for (const char *c = class_bytes[__builtin_ctz(rest)]; *c != '\0'; c++)
+                cls[(unsigned char)*c] |= 1 << g;
+
+    int i;
+    for (i = from; i < SCAN_BLOCK; i++)
+    {
+        unsigned char k = cls[(unsigned char)block[i]];
+        mask[0] |= (uint64_t)(k & 1) << i;
+        mask[1] |= (uint64_t)(k >> 1) << i;
+        if (block[i] == '\0')
+        {
+            *nul |= 1ull << i;
+            return i;
+        }
+    }
+    return SCAN_BLOCK - 1;
+}
+
+#ifdef PARSER_X86
+// so estes caminhos leem o bloco inteiro, antes do inicio da string e depois
+// do '\0': um load alinhado de 16/32 bytes fica dentro de uma pagina ja
+// mapeada, entao nao falha, e os bits fora da string sao descartados pelo
+// scan_next. Em C puro isso seria comportamento indefinido, por isso o
+// classify_scalar para nos limites da string
+__attribute__((target("avx2"), no_sanitize_address))
+static void classify_avx2(const char *block, const unsigned *sets, uint64_t *mask, uint64_t *nul)
+{
+    for (int half = 0; half < SCAN_BLOCK; half += 32)
+    {
+        __m256i v = _mm256_load_si256((const __m256i *)(block + half));
+        for (int g = 0; g < 2; g++)
+        {
+            __m256i acc = _mm256_setzero_si256();
+            for (unsigned rest = sets[g]; rest != 0; rest &= rest - 1)
+                for (const char *c = class_bytes[__builtin_ctz(rest)]; *c != '\0'; c++)
+                    acc = _mm256_or_si256(acc, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(*c)));
+            mask[g] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(acc) << half;
+        }
+        __m256i zero = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+        *nul |= (uint64_t)(uint32_t)_mm256_movemask_epi8(zero) << half;
+    }
+}
+
+__attribute__((target("sse2"), no_sanitize_address))
+static void classify_sse2(const char *block, const unsigned *sets, uint64_t *mask, uint64_t *nul)
+{
+    for (int q = 0; q < SCAN_BLOCK; q += 16)
+    {
+        __m128i v = _mm_load_si128((const __m128i *)(block + q));
+        for (int g = 0; g < 2; g++)
+        {
+            __m128i acc = _mm_setzero_si128();
+            for (unsigned rest = sets[g]; rest != 0; rest &= rest - 1)
+                for (const char *c = class_bytes[__builtin_ctz(rest)]; *c != '\0'; c++)
+                    acc = _mm_or_si128(acc, _mm_cmpeq_epi8(v, _mm_set1_epi8(*c)));
+            mask[g] |= (uint64_t)(uint32_t)_mm_movemask_epi8(acc) << q;
+        }
+        __m128i zero = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+        *nul |= (uint64_t)(uint32_t)_mm_movemask_epi8(zero) << q;
+    }
+}
+#endif
+
+// 2 = avx2, 1 = sse2, 0 = escalar; escolhido uma vez pelo cpuid ou por
+// PARSER_SIMD=sse2|scalar (para comparar no parser_bench)
+static int simd_level = -1;
+
+static int get_simd_level(void)
+{
+    if (simd_level >= 0)
+        return simd_level;
+
+    simd_level = 0;
+#ifdef PARSER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        simd_level = 2;
+    else if (__builtin_cpu_supports("sse2"))
+        simd_level = 1;
+#endif
+    const char *forced = getenv("PARSER_SIMD");
+    if (forced != NULL && strcmp(forced, "scalar") == 0)
+        simd_level = 0;
+    else if (forced != NULL && strcmp(forced, "sse2") == 0 && simd_level > 1)
+        simd_level = 1;
+    return simd_level;
+}
+
+const char *parser_simd_name(void)
+{
+    static const char *names[] = {"escalar", "sse2", "avx2"};
+    return names[get_simd_level()];
+}
+
+// ! classifica o bloco alinhado que comeca em block, a partir de block[from]
+static void scan_load(Scan *s, const char *block, int from)
+{
+    s->base = block;
+    s->mask[0] = s->mask[1] = s->nul = 0;
+    s->lo = 0;
+    s->hi = SCAN_BLOCK - 1;
+#ifdef PARSER_X86
+    switch (get_simd_level())
+    {
+    case 2: classify_avx2(block, s->sets, s->mask, &s->nul); return;
+    case 1: classify_sse2(block, s->sets, s->mask, &s->nul); return;
+    }
+#endif
+    s->lo = from;
+    s->hi = classify_scalar(block, from, s->sets, s->mask, &s->nul);
+}
+
+// ! primeiro byte a partir de p que e separador ou especial (com skip: o
+// ! primeiro que nao e separador); sempre para no '\0'
+__attribute__((always_inline))
+static inline char *scan_next(Scan *s, char *p, bool skip)
+{
+    uintptr_t off = (uintptr_t)p & (SCAN_BLOCK - 1);
+    const char *block = p - off;
+
+    while (1)
+    {
+        if (block != s->base || (int)off < s->lo || (int)off > s->hi)
+            scan_load(s, block, (int)off);
+
+        uint64_t m = skip ? ~s->mask[0] : s->mask[0] | s->mask[1];
+        m = (m | s->nul) & (~0ull << off);
+        if (m != 0)
+            return (char *)block + __builtin_ctzll(m);
+
+        block += SCAN_BLOCK;
+        off = 0;
+    }
+}
+
+// ! fim da palavra que comeca em p: o primeiro separador ou & fora de $(...) e
+// ! `...`; as substituicoes ainda sao puladas pelo skip_subst
+static char *scan_word(Scan *s, char *p)
+{
+    while (1)
+    {
+        p = scan_next(s, p, false);
+        if ((p[0] == '$' && p[1] == '(') || p[0] == '`')
+            p = skip_subst(p);
+        else if (p[0] == '$' || p[0] == '\'' || p[0] == '"')
+            p++; // aspas ainda nao agrupam palavras
+        else
+            return p;
+    }
+}
+
+// separa e retorna o numero de processos simultaneos separados por &; uma
+// passada so pela linha, com os limites dos tokens tirados das mascaras
+int simultaneos_proc(char *input, char *out_args[MAX_PROCS][MAX_ARGS + 1])
+{
+    Scan s = SCAN_INIT(CLS(CLS_BLANK), CLS(CLS_AMP) | CLS(CLS_DOLLAR) | CLS(CLS_QUOTE));
+    int proc_count = 0;
+    int argc = 0;
+    bool open = false; // o processo atual ja tem algum byte (so espacos tambem contam, como no strtok)
+    char *p = input;
+
+    TRACE('B', "parse", NULL, NULL, 0, NULL, 0);
+
+    // Remove o \n final antes: uma substituicao nao continua na linha seguinte
+    input[strcspn(input, "\n")] = '\0';
+
+    while (1)
+    {
+        char *word = scan_next(&s, p, true);
+        if (!open && (word != p || (*word != '&' && *word != '\0')))
+        {
+            if (proc_count == MAX_PROCS)
+                break;
+            open = true;
+            argc = 0;
+        }
+        p = word;
+
+        if (*p == '&')
+        {
+            if (open)
+                out_args[proc_count++][argc] = NULL;
+            open = false;
+            p++;
+            continue;
+        }
+        if (*p != '\0')
+        {
+            char *close;
+            if ((*p == '"' || *p == '\'') && argc > 0 && strcmp(out_args[proc_count][argc - 1], "<<<") == 0 &&
+                (close = strchr(p + 1, *p)) != NULL)
+            {
+                // o texto de "<<< 'a b'" e a unica palavra que as aspas agrupam
+                word = p + 1;
+                p = close;
+            }
+            else
+                p = scan_word(&s, p);
+            if (argc < MAX_ARGS)
+                out_args[proc_count][argc++] = word;
+        }
+
+        char c = *p;
+        if (c == '\0')
+        {
+            // so uma substituicao sem fechamento chega aqui com espacos no fim
+            while (p > word + 1 && p[-1] == ' ')
+                *--p = '\0';
+            break;
+        }
+        *p = '\0';
+        if (c == '&')
+        {
+            out_args[proc_count++][argc] = NULL;
+            open = false;
+        }
+        p++;
+    }
+
+    if (open)
+        out_args[proc_count++][argc] = NULL; // argv-style
+
+    TRACE('E', "parse", NULL, "procs", proc_count, NULL, 0);
+    return proc_count;
+}
+
+// separa e retorna o num de processos "dependentes" separados por |
+int split_pipeline_args(char *in_args[], char *out_args[MAX_STAGES][MAX_ARGS + 1])
+{
+    int stage = 0, argc = 0;
+
+    for (int i = 0; in_args[i] != NULL && stage < MAX_STAGES; i++)
+    {
+        if (strcmp(in_args[i], "|") == 0)
+        {
+            // fecha o estágio atual
+            out_args[stage][argc] = NULL;
+            stage++;
+            argc = 0;
+        }
+        else
+        {
+            // adiciona token ao estágio atual
+            if (argc < MAX_ARGS)
+            {
+                out_args[stage][argc++] = in_args[i];
+            }
+        }
+    }
+    // termina o último estágio
+    out_args[stage][argc] = NULL;
+    return stage + 1;
+}
+
+// ! aponta output_file para o arquivo apos > colocando em pipes
+int handle_output_file(char ** args, char **output_file)
+{
+    *output_file = NULL;
+
+    for (int i = 0; args[i] != NULL; i++)
+    {
+        if(strcmp(args[i], ">") == 0)
+        {
+            if (args[i+1] == NULL)
+            {
+                fprintf(stderr, "erro: falta nome do arquivo apos > \n");
+                return -1; // Indica a falha
+            }
+
+            *output_file = args[i+1];
+
+            args[i] = NULL;
+
+            return 1;
+        }
+    }
+    
+    return 0; // Nao ha > nos argumentos
+}
+
+// ! tira de args todos os destinos "> arq" e ">> arq", guardando em files (append[i]
+// ! = 1 para ">>"); retorna quantos (0 sem redirecao) ou -1 em erro de sintaxe
+int collect_outputs(char **args, char **files, int *append, int max)
+{
+    int count = 0, k = 0;
+
+    for (int i = 0; args[i] != NULL; i++)
+    {
+        int plain = strcmp(args[i], ">") == 0;
+        if (!plain && strcmp(args[i], ">>") != 0)
+        {
+            args[k++] = args[i];
+            continue;
+        }
+        if (args[i + 1] == NULL)
+        {
+            fprintf(stderr, "erro: falta nome do arquivo apos %s\n", args[i]);
+            return -1;
+        }
+        if (count == max)
+        {
+            fprintf(stderr, "erro: mais de %d destinos de saida\n", max);
+            return -1;
+        }
+        files[count] = args[i + 1];
+        append[count++] = !plain;
+        i++;
+    }
+    args[k] = NULL;
+    return count;
+}
+
+// ! tira de args a entrada "< arq", "<<FIM" (ou "<<-FIM") ou "<<< texto",
+// ! guardando em *file o arquivo, o delimitador ou o texto; retorna o tipo
+// ! (INPUT_*), 0 sem redirecao ou -1 em erro de sintaxe
+int collect_input(char **args, char **file)
+{
+    int kind = 0, k = 0;
+
+    *file = NULL;
+    for (int i = 0; args[i] != NULL; i++)
+    {
+        char *a = args[i];
+        int n = 0;
+        while (n < 3 && a[n] == '<')
+            n++;
+
+        // "<arq" colado continua sendo argumento, como ">arq"
+        if (n == 0 || (n == 1 && a[1] != '\0'))
+        {
+            args[k++] = a;
+            continue;
+        }
+        int type = n == 1 ? INPUT_FILE : n == 2 ? INPUT_HEREDOC : INPUT_STRING;
+        char *word = a + n;
+        if (type == INPUT_HEREDOC && *word == '-')
+            word++;
+        if (*word == '\0')
+        {
+            if (args[i + 1] == NULL)
+            {
+                fprintf(stderr, "erro: falta %s apos %s\n",
+                        type == INPUT_FILE ? "nome do arquivo" : type == INPUT_HEREDOC ? "delimitador" : "texto", a);
+                return -1;
+            }
+            word = args[++i];
+        }
+        if (kind != 0)
+        {
+            fprintf(stderr, "erro: mais de uma entrada com <, << ou <<<\n");
+            return -1;
+        }
+        *file = word;
+        kind = type;
+    }
+    args[k] = NULL;
+    return kind;
+}
+
+// ! pula uma substituicao que comeca em p ("$(" ou "`"), retorna o fim dela
+char *skip_subst(char *p)
+{
+    if (*p == '`')
+    {
+        char *end = strchr(p + 1, '`');
+        return end != NULL ? end + 1 : p + strlen(p);
+    }
+
+    int depth = 0;
+    for (p += 1; *p != '\0'; p++)
+    {
+        if (*p == '(')
+            depth++;
+        else if (*p == ')' && --depth == 0)
+            return p + 1;
+    }
+    return p; // sem fechamento: o resto da linha faz parte da substituicao
+}
+
+// ! igual ao strtok_r, mas delimitadores dentro de $(...) ou `...` nao separam
+char *strtok_subst(char *str, const char *delim, char **saveptr)
+{
+    char *p = str != NULL ? str : *saveptr;
+
+    p += strspn(p, delim);
+    if (*p == '\0')
+    {
+        *saveptr = p;
+        return NULL;
+    }
+
+    char *tok = p;
+    while (*p != '\0' && strchr(delim, *p) == NULL)
+    {
+        if ((p[0] == '$' && p[1] == '(') || p[0] == '`')
+            p = skip_subst(p);
+        else
+            p++;
+    }
+
+    if (*p != '\0')
+        *p++ = '\0';
+    *saveptr = p;
+    return tok;
+}
+
+// tokenize a line into args, return argc; token bounds come from the
+// classifier masks instead of a per-byte strtok
+int parse_args(char *line, char **args) {
+    Scan s = SCAN_INIT(CLS(CLS_BLANK) | CLS(CLS_NEWLINE), 0);
+    int argc = 0;
+    char *p = line;
+    TRACE('B', "parse", NULL, NULL, 0, NULL, 0);
+    while (argc < PARSE_MAX_ARGS-1) {
+        p = scan_next(&s, p, true);
+        if (*p == '\0') break;
+        args[argc++] = p;
+        p = scan_next(&s, p, false);
+        if (*p == '\0') break;
+        *p++ = '\0';
+    }
+    args[argc] = NULL;
+    TRACE('E', "parse", NULL, "args", argc, NULL, 0);
+    return argc;
+}
+
+char **lsh_split_line(char *line)
+{
+    int bufsize = LSH_TOK_BUFSIZE, position = 0;
+    char **tokens = malloc(bufsize * sizeof(char *));
+    Scan s = SCAN_INIT(CLS(CLS_BLANK) | CLS(CLS_NEWLINE) | CLS(CLS_CTRL), 0); // LSH_TOK_DELIM
+    char *p = line;
+
+    if (!tokens)
+    {
+        fprintf(stderr, "crash: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (1)
+    {
+        p = scan_next(&s, p, true);
+        if (*p == '\0')
+            break;
+        tokens[position] = p;
+        position++;
+
+        if (position >= bufsize)
+        {
+            bufsize += LSH_TOK_BUFSIZE;
+            tokens = realloc(tokens, bufsize * sizeof(char *));
+            if (!tokens)
+            {
+                fprintf(stderr, "crash: allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        p = scan_next(&s, p, false);
+        if (*p == '\0')
+            break;
+        *p++ = '\0';
+    }
+    tokens[position] = NULL;
+    return tokens;
+}
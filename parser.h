@@ -0,0 +1,38 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+// front end de parsing das tres shells, sem main e sem fork/exec, para poder
+// ser ligado em benchmarks e testes:
+//   gcc -c parser.c trace.c && ar rcs libparser.a parser.o trace.o
+
+#define MAX_PROCS 10    // número máximo de processos (separados por &)
+#define MAX_ARGS 20     // número máximo de argumentos por processo
+#define MAX_STAGES 10
+
+#define PARSE_MAX_ARGS 128 // limite do parse_args (base_estudo)
+#define LSH_TOK_BUFSIZE 64 // passo de crescimento do lsh_split_line (main)
+#define LSH_TOK_DELIM " \t\r\n\a"
+
+// tipos de entrada devolvidos por collect_input
+#define INPUT_FILE 1    // "< arq"
+#define INPUT_HEREDOC 2 // "<<FIM": o corpo vem das linhas seguintes
+#define INPUT_STRING 3  // "<<< texto"
+
+// shell.c
+int simultaneos_proc(char *input, char *out_args[MAX_PROCS][MAX_ARGS + 1]);
+int split_pipeline_args(char *in_args[], char *out_args[MAX_STAGES][MAX_ARGS + 1]);
+int handle_output_file(char ** args, char **output_file);
+int collect_outputs(char **args, char **files, int *append, int max);
+int collect_input(char **args, char **file);
+char *strtok_subst(char *str, const char *delim, char **saveptr);
+char *skip_subst(char *p);
+// caminho do classificador de delimitadores: "avx2", "sse2" ou "escalar"
+const char *parser_simd_name(void);
+
+// base_estudo.c
+int parse_args(char *line, char **args);
+
+// main.c
+char **lsh_split_line(char *line);
+
+#endif
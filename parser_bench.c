@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parser.h"
+
+// build: gcc -O2 -o parser_bench parser_bench.c parser.c trace.c
+// uso: parser_bench [-n linhas] [-r repeticoes] [-a args -l tamanho -d profundidade -f fanout]
+// sem -a/-l/-d/-f roda a suite padrao de corpora sinteticos
+
+#define BENCH_MAX_LINE 4096
+
+// ---- contagem de alocacoes: substitui o malloc da libc so neste binario ----
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long long alloc_count = 0;
+
+void *malloc(size_t size)
+{
+    alloc_count++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    alloc_count++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+// ---- corpus ----
+
+typedef struct
+{
+    const char *name;
+    int args;    // argumentos por estagio (alem do comando)
+    int arg_len; // tamanho de cada argumento
+    int depth;   // estagios por pipeline (separados por |)
+    int fanout;  // pipelines por linha (separadas por &)
+} CorpusSpec;
+
+typedef struct
+{
+    char **lines;
+    size_t *lens;
+    int count;
+    size_t bytes;
+} Corpus;
+
+static unsigned rng_state = 12345;
+
+static unsigned next_rand(void)
+{
+    rng_state = rng_state * 1103515245u + 12345u;
+    return rng_state >> 8;
+}
+
+static void random_word(char *out, int len)
+{
+    for (int i = 0; i < len; i++)
+        out[i] = 'a' + next_rand() % 26;
+    out[len] = '\0';
+}
+
+// ! gera count linhas no formato "cmd arg ... | cmd arg ... & ..."
+static Corpus make_corpus(const CorpusSpec *spec, int count)
+{
+    Corpus c = {malloc(count * sizeof(char *)), malloc(count * sizeof(size_t)), count, 0};
+    char word[256];
+
+    for (int i = 0; i < count; i++)
+    {
+        char line[BENCH_MAX_LINE];
+        size_t len = 0;
+
+        for (int f = 0; f < spec->fanout; f++)
+        {
+            for (int d = 0; d < spec->depth; d++)
+            {
+                random_word(word, 2 + next_rand() % 4);
+                len += snprintf(line + len, sizeof(line) - len, "%s%s", d ? " | " : (f ? " & " : ""), word);
+                for (int a = 0; a < spec->args && len < sizeof(line) - 1; a++)
+                {
+                    random_word(word, spec->arg_len);
+                    len += snprintf(line + len, sizeof(line) - len, " %s", word);
+                }
+            }
+        }
+        if (len >= sizeof(line) - 2)
+            len = sizeof(line) - 2;
+        line[len++] = '\n';
+        line[len] = '\0';
+
+        c.lines[i] = strdup(line);
+        c.lens[i] = len;
+        c.bytes += len;
+    }
+    return c;
+}
+
+static void free_corpus(Corpus *c)
+{
+    for (int i = 0; i < c->count; i++)
+        free(c->lines[i]);
+    free(c->lines);
+    free(c->lens);
+}
+
+// ---- implementacoes medidas; cada uma recebe uma copia mutavel da linha ----
+
+static size_t sink = 0; // evita que o compilador descarte o parsing
+
+// ! front end do shell.c: & -> | -> > como no loop principal
+static void run_shell(char *line)
+{
+    char *args[MAX_PROCS][MAX_ARGS + 1];
+    char *stages[MAX_STAGES][MAX_ARGS + 1];
+    int procs = simultaneos_proc(line, args);
+
+    for (int p = 0; p < procs; p++)
+    {
+        int count = split_pipeline_args(args[p], stages);
+        char *output_file;
+        handle_output_file(stages[count - 1], &output_file);
+        sink += count + (stages[0][0] != NULL);
+    }
+}
+
+// ! front end do base_estudo.c: & com strdup por comando, como o eval_line
+static void run_base_estudo(char *line)
+{
+    char *saveptr;
+    char *cmd = strtok_r(line, "&", &saveptr);
+    while (cmd)
+    {
+        char *parts = strdup(cmd);
+        char *args[PARSE_MAX_ARGS];
+        sink += parse_args(parts, args);
+        free(parts);
+        cmd = strtok_r(NULL, "&", &saveptr);
+    }
+}
+
+// ! front end do main.c
+static void run_main(char *line)
+{
+    char **tokens = lsh_split_line(line);
+    sink += tokens[0] != NULL;
+    free(tokens);
+}
+
+typedef struct
+{
+    const char *name;
+    void (*run)(char *line);
+} Impl;
+
+static const Impl impls[] = {
+    {"shell", run_shell},
+    {"base_estudo", run_base_estudo},
+    {"main", run_main},
+    {NULL, NULL}};
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ! roda uma implementacao sobre o corpus repeat vezes e imprime a linha da tabela
+static void bench(const Impl *impl, const CorpusSpec *spec, Corpus *c, int repeat)
+{
+    char work[BENCH_MAX_LINE];
+    unsigned long long allocs_before = alloc_count;
+    double start = now_seconds();
+
+    for (int r = 0; r < repeat; r++)
+    {
+        for (int i = 0; i < c->count; i++)
+        {
+            memcpy(work, c->lines[i], c->lens[i] + 1);
+            impl->run(work);
+        }
+    }
+
+    double secs = now_seconds() - start;
+    double lines = (double)c->count * repeat;
+    printf("%-14s %-12s %8.0f %12.0f %10.1f %12.3f\n", spec->name, impl->name,
+           (double)c->bytes / c->count, lines / secs, c->bytes * (double)repeat / secs / (1024 * 1024),
+           (alloc_count - allocs_before) / lines);
+}
+
+int main(int argc, char *argv[])
+{
+    static const CorpusSpec suite[] = {
+        {"curto", 2, 6, 1, 1},
+        {"largo", 18, 8, 1, 1},
+        {"linha-longa", 18, 40, 1, 1},
+        {"pipeline", 3, 6, 8, 1},
+        {"fanout", 3, 6, 1, 8},
+        {"misto", 4, 10, 4, 4},
+        {NULL, 0, 0, 0, 0}};
+    CorpusSpec custom = {"custom", -1, 8, 1, 1};
+    int lines = 20000;
+    int repeat = 20;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "uso: %s [-n linhas] [-r repeticoes] [-a args -l tamanho -d profundidade -f fanout]\n", argv[0]);
+            return 1;
+        }
+        int v = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-n") == 0) lines = v;
+        else if (strcmp(argv[i], "-r") == 0) repeat = v;
+        else if (strcmp(argv[i], "-a") == 0) custom.args = v;
+        else if (strcmp(argv[i], "-l") == 0) custom.arg_len = v;
+        else if (strcmp(argv[i], "-d") == 0) custom.depth = v;
+        else if (strcmp(argv[i], "-f") == 0) custom.fanout = v;
+        else
+        {
+            fprintf(stderr, "opcao desconhecida: %s\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+
+    const CorpusSpec *specs = suite;
+    CorpusSpec one[2] = {custom, {NULL, 0, 0, 0, 0}};
+    if (custom.args >= 0 || custom.depth != 1 || custom.fanout != 1 || custom.arg_len != 8)
+    {
+        if (one[0].args < 0)
+            one[0].args = 3;
+        specs = one;
+    }
+
+    // PARSER_SIMD=scalar|sse2 compara com os caminhos mais lentos do classificador
+    printf("classificador: %s\n", parser_simd_name());
+    printf("%-14s %-12s %8s %12s %10s %12s\n", "corpus", "parser", "bytes/l", "linhas/s", "MiB/s", "allocs/linha");
+    for (int s = 0; specs[s].name != NULL; s++)
+    {
+        Corpus c = make_corpus(&specs[s], lines);
+        for (int i = 0; impls[i].name != NULL; i++)
+            bench(&impls[i], &specs[s], &c, repeat);
+        free_corpus(&c);
+    }
+    return sink == 0; // usa o sink
+}
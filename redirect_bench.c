@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "libshell.h"
+
+// build: gcc -O2 -o redirect_bench redirect_bench.c core.c parser.c fileio.c textscan.c trace.c libshell.c
+// uso: redirect_bench [-c consumidor] [-s MiB] [-n execucoes] [-r repeticoes]
+// compara "consumidor < arq" com "cat arq | consumidor": um arquivo pequeno
+// rodado muitas vezes mede o custo de spawn, um grande mede a vazao
+
+#define BENCH_CHUNK (1 << 20)
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ! cria um arquivo temporario com size bytes de linhas de texto; retorna o caminho
+static char *make_file(long long size)
+{
+    static const char line[] = "lorem ipsum dolor sit amet 0123456789 consectetur\n";
+    char *path = strdup("/tmp/redirect_bench.XXXXXX");
+    char *buf = malloc(BENCH_CHUNK);
+    int fd = mkstemp(path);
+
+    if (fd < 0 || buf == NULL)
+    {
+        perror("redirect_bench");
+        exit(1);
+    }
+    for (size_t i = 0; i < BENCH_CHUNK; i++)
+        buf[i] = line[i % (sizeof(line) - 1)];
+    while (size > 0)
+    {
+        size_t n = size < BENCH_CHUNK ? (size_t)size : BENCH_CHUNK;
+        if (write(fd, buf, n) != (ssize_t)n)
+        {
+            perror("redirect_bench");
+            exit(1);
+        }
+        size -= n;
+    }
+    close(fd);
+    free(buf);
+    return path;
+}
+
+// ! roda line runs vezes e imprime a linha da tabela
+static void bench(sh_ctx *ctx, const char *name, const char *mode, const char *line, long long size, int runs)
+{
+    double start = now_seconds();
+
+    for (int r = 0; r < runs; r++)
+    {
+        if (sh_eval(ctx, line) != 0)
+        {
+            fprintf(stderr, "falhou: %s\n", line);
+            exit(1);
+        }
+    }
+
+    double secs = now_seconds() - start;
+    printf("%-10s %-10s %12lld %10.1f %12.1f\n", name, mode, size, runs / secs, size * (double)runs / secs / (1024 * 1024));
+}
+
+int main(int argc, char *argv[])
+{
+    const char *consumer = "cksum";
+    long long mib = 256;
+    int runs = 200;
+    int repeat = 3;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "uso: %s [-c consumidor] [-s MiB] [-n execucoes] [-r repeticoes]\n", argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-c") == 0) consumer = argv[i + 1];
+        else if (strcmp(argv[i], "-s") == 0) mib = atoll(argv[i + 1]);
+        else if (strcmp(argv[i], "-n") == 0) runs = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-r") == 0) repeat = atoi(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "opcao desconhecida: %s\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+
+    struct
+    {
+        const char *name;
+        long long size;
+        int runs;
+    } cases[] = {{"pequeno", 4096, runs}, {"grande", mib << 20, repeat}};
+    sh_ctx *ctx = sh_ctx_new();
+    char line[1024];
+
+    printf("consumidor: %s\n", consumer);
+    printf("%-10s %-10s %12s %10s %12s\n", "arquivo", "entrada", "bytes", "exec/s", "MiB/s");
+    for (int c = 0; c < 2; c++)
+    {
+        char *path = make_file(cases[c].size);
+
+        snprintf(line, sizeof(line), "%s < %s > /dev/null", consumer, path);
+        bench(ctx, cases[c].name, "<", line, cases[c].size, cases[c].runs);
+        snprintf(line, sizeof(line), "cat %s | %s > /dev/null", path, consumer);
+        bench(ctx, cases[c].name, "cat |", line, cases[c].size, cases[c].runs);
+
+        unlink(path);
+        free(path);
+    }
+    sh_ctx_free(ctx);
+    return 0;
+}
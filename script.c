@@ -0,0 +1,897 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "parser.h"
+#include "script.h"
+#include "trace.h"
+
+typedef enum
+{
+    NODE_PIPELINE, // palavras de uma pipeline, executadas pelo ops->run
+    NODE_ASSIGN,   // NOME=valor
+    NODE_SEQ,      // a ; b ; c
+    NODE_AND,      // a && b
+    NODE_OR,       // a || b
+    NODE_IF,       // if a then b else c (elif vira outro NODE_IF em c)
+    NODE_WHILE,    // while a do b
+    NODE_UNTIL,    // until a do b
+    NODE_FOR       // for name in words do a
+} NodeType;
+
+struct ScriptNode
+{
+    NodeType type;
+    char **words;     // pipeline, lista do for ou o valor da atribuicao
+    int nwords;
+    bool *dollar;     // palavra com $nome a expandir a cada execucao
+    bool background;  // pipeline terminada em &
+    char **argv;      // montado a cada execucao sem alocar
+    size_t *offs;     // posicao de cada palavra expandida em exp
+    char *exp;        // texto das palavras expandidas
+    size_t exp_cap;
+    const char *name; // variavel do for ou da atribuicao
+    ScriptNode *a, *b, *c;
+    ScriptNode **list;
+    int nlist;
+};
+
+typedef enum
+{
+    TOK_WORD,
+    TOK_SEMI, // ";" ou fim de linha
+    TOK_AMP,
+    TOK_AND,
+    TOK_OR,
+    TOK_PIPE,
+    TOK_END
+} TokType;
+
+typedef struct
+{
+    TokType type;
+    char *text;
+} Token;
+
+typedef struct
+{
+    Token *toks;
+    int pos;
+    bool incomplete; // a entrada acabou no meio de uma construcao
+    bool error;
+} Parser;
+
+// um texto compilado guardado no cache
+typedef struct
+{
+    char *src;
+    char *text; // copia tokenizada; as palavras da arvore apontam para ela
+    Token *toks;
+    ScriptNode *node;
+} Compiled;
+
+typedef struct
+{
+    char name[32];
+    char *value;
+    bool owned; // value foi alocado aqui (senao aponta para a lista de um for)
+} Var;
+
+// break/continue pendentes enquanto a pilha de execucao desenrola
+typedef enum
+{
+    CTL_NONE,
+    CTL_BREAK,
+    CTL_CONTINUE,
+    CTL_ABORT // ctrl-c: sai de todos os lacos
+} Control;
+
+static Compiled cache[SCRIPT_CACHE_SIZE];
+static Var vars[SCRIPT_MAX_VARS];
+static int nvars = 0;
+static int last_status = 0;
+static Control ctl = CTL_NONE;
+static int ctl_levels = 0;
+static int loop_depth = 0;
+static char pipe_word[] = "|";
+
+static const char *keywords[] = {"if", "then", "elif", "else", "fi", "while", "until",
+                                 "do", "done", "for", NULL};
+
+static bool is_name_char(char c, bool first)
+{
+    return c == '_' || isalpha((unsigned char)c) || (!first && isdigit((unsigned char)c));
+}
+
+// ! NOME=... com um nome valido antes do '='
+static bool is_assignment(const char *word)
+{
+    if (!is_name_char(word[0], true))
+        return false;
+    const char *p = word + 1;
+    while (is_name_char(*p, false))
+        p++;
+    return *p == '=';
+}
+
+// ! true se word tem $nome, ${nome} ou $? (nao conta $(...))
+static bool has_var(const char *word)
+{
+    for (const char *p = strchr(word, '$'); p != NULL; p = strchr(p + 1, '$'))
+        if (is_name_char(p[1], true) || p[1] == '{' || p[1] == '?')
+            return true;
+    return false;
+}
+
+// ! separa text em tokens; as palavras ficam terminadas em '\0' dentro de text
+static Token *tokenize(char *text)
+{
+    int cap = 32, n = 0;
+    Token *toks = malloc(cap * sizeof(Token));
+    char *p = text;
+    char **ends = malloc(cap * sizeof(char *)); // onde terminar cada palavra
+
+    while (toks != NULL && ends != NULL)
+    {
+        if (n + 1 >= cap)
+        {
+            cap *= 2;
+            toks = realloc(toks, cap * sizeof(Token));
+            ends = realloc(ends, cap * sizeof(char *));
+            if (toks == NULL || ends == NULL)
+                break;
+        }
+
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+            p++;
+        ends[n] = NULL;
+        toks[n].text = p;
+
+        if (*p == '\0')
+        {
+            toks[n++].type = TOK_END;
+            // so agora termina as palavras: os delimitadores ja foram lidos
+            for (int i = 0; i < n; i++)
+                if (ends[i] != NULL)
+                    *ends[i] = '\0';
+            free(ends);
+            return toks;
+        }
+
+        if (*p == '#')
+        {
+            p += strcspn(p, "\n");
+            continue;
+        }
+        if (*p == '\n' || *p == ';')
+        {
+            toks[n++].type = TOK_SEMI;
+            p++;
+        }
+        else if (*p == '&' || *p == '|')
+        {
+            bool twice = p[1] == p[0];
+            toks[n++].type = *p == '&' ? (twice ? TOK_AND : TOK_AMP) : (twice ? TOK_OR : TOK_PIPE);
+            p += twice ? 2 : 1;
+        }
+        else
+        {
+            while (*p != '\0' && strchr(" \t\r\n;&|", *p) == NULL)
+                p = (p[0] == '$' && p[1] == '(') || p[0] == '`' ? skip_subst(p) : p + 1;
+            ends[n] = p;
+            toks[n++].type = TOK_WORD;
+        }
+    }
+
+    fprintf(stderr, "erro de alocacao\n");
+    exit(EXIT_FAILURE);
+}
+
+bool script_needed(const char *line)
+{
+    const char *p = line + strspn(line, " \t");
+    size_t first = strcspn(p, " \t\r\n;&|");
+
+    for (int i = 0; keywords[i] != NULL; i++)
+        if (strlen(keywords[i]) == first && strncmp(p, keywords[i], first) == 0)
+            return true;
+    if (is_assignment(p))
+        return true;
+
+    for (; *p != '\0'; p++)
+    {
+        if ((p[0] == '$' && p[1] == '(') || p[0] == '`')
+        {
+            p = skip_subst((char *)p) - 1;
+            continue;
+        }
+        if (*p == ';' || (p[0] == '&' && p[1] == '&') || (p[0] == '|' && p[1] == '|'))
+            return true;
+        if (p[0] == '$' && (is_name_char(p[1], true) || p[1] == '{' || p[1] == '?'))
+            return true;
+    }
+    return false;
+}
+
+static ScriptNode *new_node(NodeType type)
+{
+    ScriptNode *n = calloc(1, sizeof(ScriptNode));
+    if (n == NULL)
+    {
+        fprintf(stderr, "erro de alocacao\n");
+        exit(EXIT_FAILURE);
+    }
+    n->type = type;
+    return n;
+}
+
+static void free_node(ScriptNode *n)
+{
+    if (n == NULL)
+        return;
+    free_node(n->a);
+    free_node(n->b);
+    free_node(n->c);
+    for (int i = 0; i < n->nlist; i++)
+        free_node(n->list[i]);
+    free(n->list);
+    free(n->words);
+    free(n->dollar);
+    free(n->argv);
+    free(n->offs);
+    free(n->exp);
+    free(n);
+}
+
+// ! guarda as palavras do no e ja reserva o argv reaproveitado pela execucao
+static void set_words(ScriptNode *n, char **words, int count)
+{
+    n->nwords = count;
+    n->words = malloc((count + 1) * sizeof(char *));
+    n->dollar = malloc((count + 1) * sizeof(bool));
+    n->argv = malloc((count + 1) * sizeof(char *));
+    n->offs = malloc((count + 1) * sizeof(size_t));
+    if (n->words == NULL || n->dollar == NULL || n->argv == NULL || n->offs == NULL)
+    {
+        fprintf(stderr, "erro de alocacao\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        n->words[i] = words[i];
+        n->dollar[i] = has_var(words[i]);
+    }
+    n->words[count] = NULL;
+}
+
+static Token *peek(Parser *ps)
+{
+    return &ps->toks[ps->pos];
+}
+
+static bool at_keyword(Parser *ps, const char *kw)
+{
+    Token *t = peek(ps);
+    return t->type == TOK_WORD && strcmp(t->text, kw) == 0;
+}
+
+static bool at_terminator(Parser *ps)
+{
+    static const char *ends[] = {"then", "elif", "else", "fi", "do", "done", NULL};
+    if (peek(ps)->type == TOK_END)
+        return true;
+    for (int i = 0; ends[i] != NULL; i++)
+        if (at_keyword(ps, ends[i]))
+            return true;
+    return false;
+}
+
+static void skip_newlines(Parser *ps)
+{
+    while (peek(ps)->type == TOK_SEMI)
+        ps->pos++;
+}
+
+// ! marca erro de sintaxe, ou entrada incompleta se o problema for o fim
+static ScriptNode *syntax_error(Parser *ps, const char *expected)
+{
+    if (peek(ps)->type == TOK_END)
+        ps->incomplete = true;
+    else if (!ps->error)
+        fprintf(stderr, "erro de sintaxe: esperado %s perto de '%s'\n", expected,
+                peek(ps)->type == TOK_WORD ? peek(ps)->text : "operador");
+    ps->error = true;
+    return NULL;
+}
+
+static bool expect_keyword(Parser *ps, const char *kw)
+{
+    if (!at_keyword(ps, kw))
+    {
+        syntax_error(ps, kw);
+        return false;
+    }
+    ps->pos++;
+    return true;
+}
+
+static ScriptNode *parse_list(Parser *ps);
+
+// ! if LISTA then LISTA [elif LISTA then LISTA]... [else LISTA] fi
+static ScriptNode *parse_if(Parser *ps)
+{
+    ScriptNode *n = new_node(NODE_IF);
+    ps->pos++; // if ou elif
+    n->a = parse_list(ps);
+    if (n->a == NULL || !expect_keyword(ps, "then") || (n->b = parse_list(ps)) == NULL)
+        return free_node(n), NULL;
+
+    if (at_keyword(ps, "elif"))
+    {
+        n->c = parse_if(ps); // consome o fi
+        return n->c != NULL ? n : (free_node(n), NULL);
+    }
+    if (at_keyword(ps, "else"))
+    {
+        ps->pos++;
+        if ((n->c = parse_list(ps)) == NULL)
+            return free_node(n), NULL;
+    }
+    if (!expect_keyword(ps, "fi"))
+        return free_node(n), NULL;
+    return n;
+}
+
+// ! while|until LISTA do LISTA done
+static ScriptNode *parse_while(Parser *ps)
+{
+    ScriptNode *n = new_node(at_keyword(ps, "while") ? NODE_WHILE : NODE_UNTIL);
+    ps->pos++;
+    n->a = parse_list(ps);
+    if (n->a == NULL || !expect_keyword(ps, "do") || (n->b = parse_list(ps)) == NULL
+        || !expect_keyword(ps, "done"))
+        return free_node(n), NULL;
+    return n;
+}
+
+// ! for NOME in PALAVRAS ; do LISTA done
+static ScriptNode *parse_for(Parser *ps)
+{
+    ScriptNode *n = new_node(NODE_FOR);
+    char *words[4096];
+    int count = 0;
+
+    ps->pos++;
+    if (peek(ps)->type != TOK_WORD || !is_name_char(peek(ps)->text[0], true))
+        return free_node(n), syntax_error(ps, "nome da variavel");
+    n->name = peek(ps)->text;
+    ps->pos++;
+    if (!expect_keyword(ps, "in"))
+        return free_node(n), NULL;
+
+    while (peek(ps)->type == TOK_WORD && count < (int)(sizeof(words) / sizeof(words[0])))
+        words[count++] = peek(ps)->text, ps->pos++;
+    if (peek(ps)->type != TOK_SEMI)
+        return free_node(n), syntax_error(ps, "';' ou fim de linha");
+    set_words(n, words, count);
+
+    skip_newlines(ps);
+    if (!expect_keyword(ps, "do") || (n->a = parse_list(ps)) == NULL || !expect_keyword(ps, "done"))
+        return free_node(n), NULL;
+    return n;
+}
+
+// ! comando: construcao de controle, atribuicao ou pipeline (palavras e "|")
+static ScriptNode *parse_command(Parser *ps)
+{
+    if (at_keyword(ps, "if"))
+        return parse_if(ps);
+    if (at_keyword(ps, "while") || at_keyword(ps, "until"))
+        return parse_while(ps);
+    if (at_keyword(ps, "for"))
+        return parse_for(ps);
+    if (peek(ps)->type != TOK_WORD || at_terminator(ps))
+        return syntax_error(ps, "comando");
+
+    char *words[MAX_STAGES * (MAX_ARGS + 1)];
+    int count = 0;
+    while (count < (int)(sizeof(words) / sizeof(words[0])) - 1)
+    {
+        if (peek(ps)->type == TOK_WORD)
+        {
+            words[count++] = peek(ps)->text;
+            ps->pos++;
+        }
+        else if (peek(ps)->type == TOK_PIPE)
+        {
+            words[count++] = pipe_word;
+            ps->pos++;
+            skip_newlines(ps);
+            if (peek(ps)->type != TOK_WORD)
+                return syntax_error(ps, "comando depois de |");
+        }
+        else
+            break;
+    }
+
+    if (count == 1 && is_assignment(words[0]))
+    {
+        ScriptNode *n = new_node(NODE_ASSIGN);
+        char *eq = strchr(words[0], '=');
+        *eq = '\0'; // o nome termina ali, o valor comeca depois
+        n->name = words[0];
+        words[0] = eq + 1;
+        set_words(n, words, 1);
+        return n;
+    }
+
+    ScriptNode *n = new_node(NODE_PIPELINE);
+    set_words(n, words, count);
+    return n;
+}
+
+// ! comandos ligados por && e ||, avaliados da esquerda para a direita
+static ScriptNode *parse_and_or(Parser *ps)
+{
+    ScriptNode *left = parse_command(ps);
+    while (left != NULL && (peek(ps)->type == TOK_AND || peek(ps)->type == TOK_OR))
+    {
+        ScriptNode *n = new_node(peek(ps)->type == TOK_AND ? NODE_AND : NODE_OR);
+        ps->pos++;
+        skip_newlines(ps);
+        n->a = left;
+        n->b = parse_command(ps);
+        if (n->b == NULL)
+            return free_node(n), NULL;
+        left = n;
+    }
+    return left;
+}
+
+// ! sequencia separada por ';', fim de linha ou '&' ate um terminador
+static ScriptNode *parse_list(Parser *ps)
+{
+    ScriptNode *seq = new_node(NODE_SEQ);
+    int cap = 0;
+
+    skip_newlines(ps);
+    while (!at_terminator(ps))
+    {
+        ScriptNode *n = parse_and_or(ps);
+        if (n == NULL)
+            return free_node(seq), NULL;
+
+        if (seq->nlist == cap)
+        {
+            cap = cap ? cap * 2 : 4;
+            seq->list = realloc(seq->list, cap * sizeof(ScriptNode *));
+            if (seq->list == NULL)
+            {
+                fprintf(stderr, "erro de alocacao\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        seq->list[seq->nlist++] = n;
+
+        if (peek(ps)->type == TOK_AMP)
+        {
+            // sem subshell: so uma pipeline simples pode ir para o fundo
+            if (n->type != NODE_PIPELINE)
+                return free_node(seq), syntax_error(ps, "pipeline simples antes de &");
+            n->background = true;
+            ps->pos++;
+        }
+        else if (peek(ps)->type != TOK_SEMI && !at_terminator(ps))
+            return free_node(seq), syntax_error(ps, "';'");
+        skip_newlines(ps);
+    }
+
+    if (seq->nlist == 0 && peek(ps)->type != TOK_END)
+        return free_node(seq), syntax_error(ps, "comando");
+    return seq;
+}
+
+static unsigned hash_text(const char *s)
+{
+    unsigned h = 2166136261u;
+    for (; *s != '\0'; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+ScriptNode *script_compile(const char *src, bool *incomplete)
+{
+    Compiled *slot = &cache[hash_text(src) % SCRIPT_CACHE_SIZE];
+    *incomplete = false;
+    if (slot->src != NULL && strcmp(slot->src, src) == 0)
+        return slot->node;
+
+    TRACE('B', "script_compile", NULL, "len", strlen(src), NULL, 0);
+    Compiled c = {strdup(src), strdup(src), NULL, NULL};
+    if (c.src == NULL || c.text == NULL)
+    {
+        fprintf(stderr, "erro de alocacao\n");
+        exit(EXIT_FAILURE);
+    }
+    c.toks = tokenize(c.text);
+
+    Parser ps = {c.toks, 0, false, false};
+    c.node = parse_list(&ps);
+    if (c.node != NULL && peek(&ps)->type != TOK_END)
+    {
+        syntax_error(&ps, "fim da linha");
+        free_node(c.node);
+        c.node = NULL;
+    }
+    TRACE('E', "script_compile", NULL, "ok", c.node != NULL, "incomplete", ps.incomplete);
+
+    if (c.node == NULL)
+    {
+        *incomplete = ps.incomplete;
+        free(c.src);
+        free(c.text);
+        free(c.toks);
+        return NULL;
+    }
+
+    // texto novo substitui o que estava no slot (mapeamento direto)
+    if (slot->src != NULL)
+    {
+        free_node(slot->node);
+        free(slot->src);
+        free(slot->text);
+        free(slot->toks);
+    }
+    *slot = c;
+    return c.node;
+}
+
+static Var *find_var(const char *name, size_t len)
+{
+    for (int i = 0; i < nvars; i++)
+        if (strlen(vars[i].name) == len && strncmp(vars[i].name, name, len) == 0)
+            return &vars[i];
+    return NULL;
+}
+
+// ! define uma variavel; copy = false guarda o ponteiro (lista de um for)
+static void set_var(const char *name, char *value, bool copy)
+{
+    Var *v = find_var(name, strlen(name));
+    if (v == NULL)
+    {
+        if (nvars == SCRIPT_MAX_VARS || strlen(name) >= sizeof(vars[0].name))
+        {
+            fprintf(stderr, "erro: variaveis demais (max %d)\n", SCRIPT_MAX_VARS);
+            return;
+        }
+        v = &vars[nvars++];
+        strcpy(v->name, name);
+        v->value = NULL;
+        v->owned = false;
+    }
+    if (v->owned)
+        free(v->value);
+    v->value = copy ? strdup(value) : value;
+    v->owned = copy;
+}
+
+const char *script_getvar(const char *name)
+{
+    Var *v = find_var(name, strlen(name));
+    return v != NULL ? v->value : getenv(name);
+}
+
+// ! acrescenta len bytes ao texto expandido do no
+static void exp_append(ScriptNode *n, size_t *used, const char *data, size_t len)
+{
+    if (*used + len + 1 > n->exp_cap)
+    {
+        size_t cap = n->exp_cap ? n->exp_cap : 256;
+        while (cap < *used + len + 1)
+            cap *= 2;
+        n->exp = realloc(n->exp, cap);
+        if (n->exp == NULL)
+        {
+            fprintf(stderr, "erro de alocacao\n");
+            exit(EXIT_FAILURE);
+        }
+        n->exp_cap = cap;
+    }
+    memcpy(n->exp + *used, data, len);
+    *used += len;
+}
+
+// ! troca $nome, ${nome} e $? de word pelo valor, no fim de n->exp
+static void expand_word(ScriptNode *n, size_t *used, const char *word)
+{
+    const char *p = word;
+    while (*p != '\0')
+    {
+        const char *dollar = strchr(p, '$');
+        if (dollar == NULL)
+        {
+            exp_append(n, used, p, strlen(p));
+            break;
+        }
+        exp_append(n, used, p, (size_t)(dollar - p));
+
+        const char *name = dollar + 1;
+        size_t len = 0;
+        const char *after;
+        if (*name == '?')
+        {
+            char num[16];
+            int k = snprintf(num, sizeof(num), "%d", last_status);
+            exp_append(n, used, num, (size_t)k);
+            p = name + 1;
+            continue;
+        }
+        if (*name == '{')
+        {
+            name++;
+            while (name[len] != '\0' && name[len] != '}')
+                len++;
+            after = name[len] == '}' ? name + len + 1 : name + len;
+        }
+        else
+        {
+            while (is_name_char(name[len], len == 0))
+                len++;
+            after = name + len;
+        }
+        if (len == 0)
+        {
+            exp_append(n, used, "$", 1); // "$(" e "$" sozinho ficam como estao
+            p = dollar + 1;
+            continue;
+        }
+
+        char key[64];
+        snprintf(key, sizeof(key), "%.*s", (int)len, name);
+        const char *value = script_getvar(key);
+        if (value != NULL)
+            exp_append(n, used, value, strlen(value));
+        p = after;
+    }
+    exp_append(n, used, "", 1);
+}
+
+// ! monta o argv do no; palavras sem variaveis apontam para o texto compilado
+static char **build_argv(ScriptNode *n)
+{
+    size_t used = 0;
+    for (int i = 0; i < n->nwords; i++)
+    {
+        if (!n->dollar[i])
+        {
+            n->argv[i] = n->words[i];
+            continue;
+        }
+        n->offs[i] = used;
+        expand_word(n, &used, n->words[i]);
+    }
+    // exp pode ter sido realocado no meio: os ponteiros so saem no fim
+    for (int i = 0; i < n->nwords; i++)
+        if (n->dollar[i])
+            n->argv[i] = n->exp + n->offs[i];
+    n->argv[n->nwords] = NULL;
+    return n->argv;
+}
+
+// ! break [N] / continue [N] dentro de um laco
+static bool loop_control(char **argv)
+{
+    bool is_break = strcmp(argv[0], "break") == 0;
+    if (!is_break && strcmp(argv[0], "continue") != 0)
+        return false;
+
+    int levels = argv[1] != NULL ? atoi(argv[1]) : 1;
+    if (loop_depth > 0 && levels > 0)
+    {
+        ctl = is_break ? CTL_BREAK : CTL_CONTINUE;
+        ctl_levels = levels < loop_depth ? levels : loop_depth;
+    }
+    return true;
+}
+
+static int run_node(ScriptNode *n, const ScriptOps *ops);
+
+// ! depois do corpo de um laco: true se o laco deve parar
+static bool loop_stop(void)
+{
+    if (ctl == CTL_NONE)
+        return false;
+    if (ctl == CTL_ABORT)
+        return true;
+    if (--ctl_levels > 0)
+        return true; // break/continue de um laco mais externo
+    bool stop = ctl == CTL_BREAK;
+    ctl = CTL_NONE;
+    return stop;
+}
+
+// ! checa ctrl-c entre iteracoes
+static bool loop_interrupted(const ScriptOps *ops)
+{
+    if (ops->interrupted != NULL && ops->interrupted(ops->ctx))
+    {
+        ctl = CTL_ABORT;
+        last_status = 130;
+        return true;
+    }
+    return false;
+}
+
+// ! expande a lista de um for: $(...) inteiro vira varias palavras
+static char **for_items(ScriptNode *n, const ScriptOps *ops, int *count, char ***owned, int *nowned)
+{
+    int cap = n->nwords + 16;
+    char **items = malloc(cap * sizeof(char *));
+    char **argv = build_argv(n);
+
+    *count = 0;
+    *owned = malloc((n->nwords + 1) * sizeof(char *));
+    *nowned = 0;
+    if (items == NULL || *owned == NULL)
+    {
+        fprintf(stderr, "erro de alocacao\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < n->nwords; i++)
+    {
+        char *w = argv[i];
+        size_t len = strlen(w);
+        bool subst = ops->capture != NULL && len > 2
+                     && ((w[0] == '$' && w[1] == '(' && w[len - 1] == ')') || (w[0] == '`' && w[len - 1] == '`'));
+        char *text;
+        if (subst)
+        {
+            size_t skip = w[0] == '`' ? 1 : 2;
+            char *cmd = strndup(w + skip, len - skip - 1);
+            text = cmd != NULL ? ops->capture(cmd, ops->ctx) : NULL;
+            free(cmd);
+            if (text == NULL)
+                continue;
+        }
+        else
+        {
+            text = strdup(w); // argv e reaproveitado pelo proximo uso do no
+        }
+        (*owned)[(*nowned)++] = text;
+
+        if (!subst)
+        {
+            if (*count == cap)
+                items = realloc(items, (cap *= 2) * sizeof(char *));
+            items[(*count)++] = text;
+            continue;
+        }
+        // separa a saida no proprio buffer, sem limite de palavras
+        char *save;
+        for (char *tok = strtok_r(text, " \t\n", &save); tok != NULL; tok = strtok_r(NULL, " \t\n", &save))
+        {
+            if (*count == cap)
+            {
+                items = realloc(items, (cap *= 2) * sizeof(char *));
+                if (items == NULL)
+                {
+                    fprintf(stderr, "erro de alocacao\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            items[(*count)++] = tok;
+        }
+    }
+    return items;
+}
+
+static int run_for(ScriptNode *n, const ScriptOps *ops)
+{
+    int count, nowned;
+    char **owned;
+    char **items = for_items(n, ops, &count, &owned, &nowned);
+    int status = 0;
+
+    loop_depth++;
+    for (int i = 0; i < count && !loop_interrupted(ops); i++)
+    {
+        set_var(n->name, items[i], false);
+        status = run_node(n->a, ops);
+        if (loop_stop())
+            break;
+    }
+    loop_depth--;
+
+    // a variavel continua com o ultimo valor depois que a lista e liberada
+    if (count > 0)
+        set_var(n->name, script_getvar(n->name) != NULL ? (char *)script_getvar(n->name) : "", true);
+    for (int i = 0; i < nowned; i++)
+        free(owned[i]);
+    free(owned);
+    free(items);
+    return status;
+}
+
+static int run_while(ScriptNode *n, const ScriptOps *ops)
+{
+    int status = 0;
+
+    loop_depth++;
+    while (!loop_interrupted(ops))
+    {
+        int cond = run_node(n->a, ops);
+        if (ctl != CTL_NONE && loop_stop())
+            break;
+        if ((cond == 0) != (n->type == NODE_WHILE))
+            break;
+        status = run_node(n->b, ops);
+        if (loop_stop())
+            break;
+    }
+    loop_depth--;
+    return status;
+}
+
+static int run_node(ScriptNode *n, const ScriptOps *ops)
+{
+    int status = 0;
+
+    switch (n->type)
+    {
+    case NODE_PIPELINE:
+    {
+        char **argv = build_argv(n);
+        if (argv[0] == NULL || loop_control(argv))
+            return last_status;
+        status = ops->run(argv, n->background, ops->ctx);
+        break;
+    }
+    case NODE_ASSIGN:
+        set_var(n->name, build_argv(n)[0], true);
+        break;
+    case NODE_SEQ:
+        status = last_status;
+        for (int i = 0; i < n->nlist && ctl == CTL_NONE; i++)
+            status = run_node(n->list[i], ops);
+        return status;
+    case NODE_AND:
+    case NODE_OR:
+        status = run_node(n->a, ops);
+        if (ctl == CTL_NONE && (status == 0) == (n->type == NODE_AND))
+            status = run_node(n->b, ops);
+        return status;
+    case NODE_IF:
+        status = run_node(n->a, ops);
+        if (ctl != CTL_NONE)
+            return status;
+        if (status == 0)
+            return run_node(n->b, ops);
+        return n->c != NULL ? run_node(n->c, ops) : 0;
+    case NODE_WHILE:
+    case NODE_UNTIL:
+        status = run_while(n, ops);
+        break;
+    case NODE_FOR:
+        status = run_for(n, ops);
+        break;
+    }
+
+    last_status = status;
+    return status;
+}
+
+int script_run(ScriptNode *node, const ScriptOps *ops)
+{
+    ctl = CTL_NONE;
+    loop_depth = 0;
+    int status = run_node(node, ops);
+    if (ctl == CTL_ABORT)
+        status = 130; // 128 + SIGINT, como o sh
+    ctl = CTL_NONE;
+    last_status = status;
+    return status;
+}
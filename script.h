@@ -0,0 +1,38 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdbool.h>
+
+// construcoes de controle (";", "&&", "||", if, while/until, for) compiladas
+// uma vez numa arvore; o interpretador percorre a arvore sem tokenizar de
+// novo e reaproveita os argv de uma iteracao para a outra. Quem executa as
+// pipelines e a shell hospedeira, pelos callbacks de ScriptOps.
+
+#define SCRIPT_CACHE_SIZE 64 // textos compilados lembrados por script_compile
+#define SCRIPT_MAX_VARS 64   // variaveis de for e de atribuicoes NOME=valor
+
+typedef struct ScriptNode ScriptNode;
+
+typedef struct
+{
+    // roda uma pipeline (palavras com "|", ">" e ">>", terminadas em NULL);
+    // retorna o status, ou 0 sem esperar quando background
+    int (*run)(char **words, bool background, void *ctx);
+    // saida de $(cmd) para listas de for, alocada com malloc; NULL sem suporte
+    char *(*capture)(const char *cmd, void *ctx);
+    // consultado a cada iteracao; true interrompe os lacos (ctrl-c)
+    bool (*interrupted)(void *ctx);
+    void *ctx;
+} ScriptOps;
+
+// true se a linha usa alguma construcao que so o interpretador entende
+bool script_needed(const char *line);
+// compila src (uma ou mais linhas); a arvore fica no cache e nao deve ser
+// liberada. NULL com *incomplete = true quando falta fechar algo (fi, done...)
+ScriptNode *script_compile(const char *src, bool *incomplete);
+// executa a arvore; retorna o status do ultimo comando
+int script_run(ScriptNode *node, const ScriptOps *ops);
+// valor de uma variavel do interpretador (ou do ambiente), NULL se nao existe
+const char *script_getvar(const char *name);
+
+#endif
@@ -1,33 +1,15 @@
-#include <stdio.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <sys/stat.h>
-#include <dirent.h>
-#include <fcntl.h>
-#include <linux/limits.h>
-#include <stdbool.h>
-
-#define MAX_LINE 1024
-#define MAX_PROCS 10    // número máximo de processos (separados por &)
-#define MAX_ARGS 20     // número máximo de argumentos por processo
-#define BUFFER_SIZE 256 // tamanho máximo da linha de entrada
-#define MAX_STAGES 10
-
-int simultaneos_proc(char *input, char *out_args[MAX_PROCS][MAX_ARGS + 1]);
-int split_pipeline_args(char *in_args[], char *out_args[MAX_STAGES][MAX_ARGS + 1]);
+#define _GNU_SOURCE
+#include "shell.h"
+
+// build: gcc -o shell shell.c core.c parser.c daemon.c fileio.c textscan.c trace.c script.c
+// uso: shell | shell --daemon SOCK | shell [-t] -c linha (SHELL_DAEMON=SOCK usa o daemon)
+
 void print_args(char *row[]);
-int is_builtin(char *comand);
-void execute(char **args);
-void execute_pipeline(char *stages[MAX_STAGES][MAX_ARGS + 1], int stage_count);
-pid_t launch_process(int in_fd, int out_fd, char **args);
-int count_args(char **args);
-bool validate_command(char **args);
-int handle_output_file(char ** args, char **output_file);
-void fillPathsList(char **args,Lista*paths);
+static int run_pipeline(char *pipe_args[MAX_STAGES][MAX_ARGS + 1], int stage_count, bool tail, bool wait);
+static int script_run_words(char **words, bool background, void *ctx);
+static char *script_capture(const char *cmd, void *ctx);
+static bool script_interrupted(void *ctx);
+static int heredoc_line(char *buf, size_t size, void *ctx);
 
 typedef struct element{
     char valor[MAX_STAGES];
@@ -35,9 +17,14 @@ typedef struct element{
 }Lista;
 
 Lista* init();
-Lista* insert(Lista* receba,char valor[MAX_ARGS]);
+Lista* insert(Lista* receba,char valor[]);
 Lista* removeFrom(Lista* deleted);
 void printAll(Lista *p);
+void liberaLista(Lista* list);
+void fillPathsList(char **args,Lista*paths);
+
+static PathCache session_cache;
+static ExecEnv session_env = {&session_cache, NULL, NULL, -1, -1, false};
 
 // TODO validacao de erros, help, comandos exigidos pelo denis como cd, ls, ...
 // TODO comando cd atualmente nao funcion, utilizar a fun is_builtin para tratar e executa-lo
@@ -54,389 +41,341 @@ int main(int argc, char *argv[])
     int stage_count;
     int procs = 0;
 
-    FILE *input = stdin; // para leitura constante do stdin
+    trace_from_env();
+    if (argc == 3 && strcmp(argv[1], "--daemon") == 0)
+        return run_daemon(argv[2]);
+    if (argc >= 3 && (strcmp(argv[1], "-c") == 0 || (argc == 4 && strcmp(argv[1], "-t") == 0 && strcmp(argv[2], "-c") == 0)))
+        return run_command(argv[argc - 1], argc == 4);
+
+    init_topology();
+    init_events(true);
+    exec_env = &session_env;
 
     while (1)
     {
         printAll(paths);
-        fflush(stdin);
+        free_line_allocs();
         stage_count = 0; // # stage_count contem o numero de proc de devem ser executados via pipe onde: proc_1 > stout >> proc_2 >stdin
 
         if (getcwd(cwd, sizeof(cwd)) == NULL) // serve apenas para pegar o diretorio atual 
             break;
 
-        if (input == stdin) // printa o dir atual antes de pedir entrada
-            printf("%s $: ", cwd);
+        printf("%s $: ", cwd); // printa o dir atual antes de pedir entrada
+        fflush(stdout);
 
-        if (fgets(line, sizeof(line), input) == NULL)
-            break; // ! sai em caso de erro na leitura
+        int got = read_line(line, sizeof(line));
+        if (got == 0)
+            break; // ! sai no fim da entrada ou em erro na leitura
+        if (got < 0)
+        {
+            printf("\n"); // ctrl-c no prompt descarta a linha
+            continue;
+        }
 
         if (line[0] == '\n' || line[0] == '\0')
             continue;
 
+        if (script_needed(line))
+        {
+            // if/while/for, ";", "&&", "||" e variaveis: junta as linhas de
+            // continuacao ate a construcao fechar e roda a arvore compilada
+            char script[MAX_LINE * 16];
+            bool incomplete;
+            ScriptNode *tree;
+            snprintf(script, sizeof(script), "%s", line);
+            while ((tree = script_compile(script, &incomplete)) == NULL && incomplete)
+            {
+                size_t used = strlen(script);
+                printf("> ");
+                fflush(stdout);
+                if (used + 1 >= sizeof(script) || read_line(script + used, sizeof(script) - used) <= 0)
+                    break;
+            }
+            if (tree != NULL)
+            {
+                ScriptOps ops = {script_run_words, script_capture, script_interrupted, NULL};
+                script_run(tree, &ops);
+            }
+            wait_foreground();
+            continue;
+        }
+
+        // corpos de "<<FIM" vem das proximas linhas, antes de rodar qualquer pipeline
+        if (read_heredocs(line, heredoc_line, NULL) < 0)
+            continue;
+
         procs = simultaneos_proc(line, args);
 
         for (int p = 0; p < procs; p++)
         {
             stage_count = split_pipeline_args(args[p], pipe_args);
-
-            bool pipe_is_valid = true;
-
-            if(strcmp(pipe_args[0][0], "path") == 0){
-                fillPathsList(args,paths);
-                continue;
-            }
-            for (int s = 0; s < stage_count; s++)
+            if (pipe_args[0][0] != NULL && strcmp(pipe_args[0][0], "path") == 0)
             {
-                if (pipe_args[s][0] == NULL)
-                {
-                    fprintf(stderr, "Erro: pipeline vazia\n");
-                    continue;;
-                }
-                
-                if (!validate_command(pipe_args[s]))
-                {
-                    pipe_is_valid = false;
-                    continue;
-                }
-            }
-
-            if (pipe_is_valid)
-            {    
-                if (stage_count > 1)
-                {
-                    execute_pipeline(pipe_args, stage_count);
-                }
-                else
-                {
-                    execute(pipe_args[0]);
-                    continue;
-                }
+                fillPathsList(pipe_args[0],paths);
+                continue;
             }
+            run_pipeline(pipe_args, stage_count, p == procs - 1, false);
         }
+
+        // os processos separados por & rodam juntos, o prompt volta quando todos terminam
+        wait_foreground();
     }
 }
 
-// separa e retorna o numero de processos simultaneos separados por &
-int simultaneos_proc(char *input, char *out_args[MAX_PROCS][MAX_ARGS + 1])
+// ! prefixos (affinity, timeout, measure, trace), validacao e lancamento de
+// ! uma pipeline; com wait espera o job e retorna o status dele
+static int launch_pipeline(char *pipe_args[MAX_STAGES][MAX_ARGS + 1], int stage_count, bool tail, bool wait)
 {
-    char *procs[MAX_PROCS];
-    int proc_count = 0;
+    static Placement line_place;
+    static TimeoutSpec line_timeout;
+    bool pipe_is_valid = true;
+    int j;
+
+    tail_inline = false; // $(...) da linha captura por pipe, nao pode rodar dentro
+    if (expand_substitutions(pipe_args, stage_count) < 0)
+        return 1;
 
-    // Remove o \n final
-    input[strcspn(input, "\n")] = '\0';
+    if (pipe_args[0][0] == NULL)
+        return 0;
 
-    // Separar por '&'
-    char *saveptr_proc;
-    char *tok_proc = strtok_r(input, "&", &saveptr_proc);
-    while (tok_proc && proc_count < MAX_PROCS)
+    measure_line = false;
+
+    WatchSpec watch;
+    bool watching = false;
+    if (strcmp(pipe_args[0][0], "watch") == 0)
     {
-        // Trim espaços iniciais
-        while (*tok_proc == ' ')
-            tok_proc++;
-        // Trim espaços finais
-        char *end = tok_proc + strlen(tok_proc) - 1;
-        while (end > tok_proc && *end == ' ')
-        {
-            *end = '\0';
-            end--;
-        }
-        procs[proc_count++] = tok_proc;
-        tok_proc = strtok_r(NULL, "&", &saveptr_proc);
+        // "watch [--on CAMINHO]... [--interval T] cmd | ...": vem antes dos
+        // outros prefixos, que passam a valer para cada execucao do watch
+        if (parse_watch(pipe_args[0], &watch) < 0)
+            return 1;
+        watching = true;
     }
 
-    // Para cada processo, separar em argumentos
-    for (int p = 0; p < proc_count; p++)
+    if (strcmp(pipe_args[0][0], "affinity") == 0)
     {
-        int argc = 0;
-        char *saveptr_arg;
-        char *tok_arg = strtok_r(procs[p], " \t", &saveptr_arg);
-        while (tok_arg && argc < MAX_ARGS)
+        // "affinity MODO [cpus] -- cmd | ..." vale so para esta pipeline
+        char *opts[MAX_ARGS + 1];
+        memcpy(opts, pipe_args[0], sizeof(opts));
+        int sep = strip_prefix(pipe_args[0]);
+        if (sep < 0)
+            return builtin_affinity(pipe_args[0], &session_place) != 0;
+
+        opts[sep] = NULL;
+        line_place = session_place;
+        if (builtin_affinity(opts, &line_place) != 0)
+            return 1;
+        current_place = &line_place;
+        if (pipe_args[0][0] == NULL)
         {
-            out_args[p][argc++] = tok_arg;
-            tok_arg = strtok_r(NULL, " \t", &saveptr_arg);
+            fprintf(stderr, "uso: affinity <modo> [cpus] -- comando\n");
+            return 1;
         }
-        out_args[p][argc] = NULL; // argv-style
     }
 
-    return proc_count;
-}
-
-// ! funcao para debugar os args
-void print_args(char *row[])
-{
-    if (row == NULL)
+    if (strcmp(pipe_args[0][0], "timeout") == 0)
     {
-        printf("Erro: row é NULL\n");
-        return;
+        // "timeout DUR [--kill-after D] cmd | ..." vale so para esta pipeline
+        int r = builtin_timeout(pipe_args[0], &session_timeout, &line_timeout);
+        if (r != 1)
+            return r < 0;
+        current_timeout = &line_timeout;
     }
 
-    for (int i = 0; row[i] != NULL; i++)
+    if (strcmp(pipe_args[0][0], "measure") == 0)
     {
-        printf("%s", row[i]);
-        if (row[i + 1] != NULL)
-            printf(" "); // espaço entre argumentos
-    }
-    printf("\n");
-}
-
-// separa e retorna o num de processos "dependentes" separados por |
-int split_pipeline_args(char *in_args[], char *out_args[MAX_STAGES][MAX_ARGS + 1])
-{
-    int stage = 0, argc = 0;
-
-    for (int i = 0; in_args[i] != NULL && stage < MAX_STAGES; i++)
-    {
-        if (strcmp(in_args[i], "|") == 0)
-        {
-            // fecha o estágio atual
-            out_args[stage][argc] = NULL;
-            stage++;
-            argc = 0;
-        }
-        else
+        // "measure on|off" vale para a sessao, "measure -- cmd | ..." so para esta pipeline
+        if (strip_prefix(pipe_args[0]) < 0)
         {
-            // adiciona token ao estágio atual
-            if (argc < MAX_ARGS)
+            if (pipe_args[0][1] == NULL)
+                printf("measure: %s\n", measure_session ? "on" : "off");
+            else if (strcmp(pipe_args[0][1], "on") == 0 && pipe_args[0][2] == NULL)
+                measure_session = true;
+            else if (strcmp(pipe_args[0][1], "off") == 0 && pipe_args[0][2] == NULL)
+                measure_session = false;
+            else
             {
-                out_args[stage][argc++] = in_args[i];
+                fprintf(stderr, "uso: measure [on|off] | measure -- comando | ...\n");
+                return 1;
             }
+            return 0;
         }
-    }
-    // termina o último estágio
-    out_args[stage][argc] = NULL;
-    return stage + 1;
-}
-
-// ! func que executa comando simples, no caso comandos seperados por &
-void execute(char **args)
-{
-    char *output_file = NULL;
-    int out_fd = STDOUT_FILENO;
-    int status;
-
-    status = handle_output_file(args, &output_file);
-
-    if (status == -1) return; // erro de sintaxe
-
-    if (output_file != NULL)
-    {
-        out_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (out_fd < 0)
+        if (pipe_args[0][0] == NULL)
         {
-            perror("erro ao abrir o aquivo\n");
-            return;
+            fprintf(stderr, "uso: measure -- comando | ...\n");
+            return 1;
         }
+        measure_line = true;
     }
 
-    pid_t pid = launch_process(STDIN_FILENO, out_fd, args);
-
-    if (out_fd != STDOUT_FILENO)
-    {
-        close(out_fd);
-    }
-    
-    if (pid > 0 )
-    {
-        waitpid(pid, NULL, 0);
-    }
-}
-
-// ! cria e lanca o processo com pipes para comunicacao com outro processo
-pid_t launch_process(int in_fd, int out_fd, char **args)
-{
-    pid_t pid = fork();
-
-    if (pid < 0)
+    if (strcmp(pipe_args[0][0], "trace") == 0)
     {
-        perror("fork error");
-        return -1; // Retorna -1 para indicar erro no fork
-    }
-
-    if (pid == 0)
-    { // Processo Filho
-        if (in_fd != STDIN_FILENO) // redireciona para entrada padrao
+        // "trace on ARQ [jsonl|chrome]", "trace flush", "trace off"
+        char **a = pipe_args[0];
+        if (a[1] != NULL && strcmp(a[1], "on") == 0 && a[2] != NULL && (a[3] == NULL || a[4] == NULL))
         {
-            if (dup2(in_fd, STDIN_FILENO) < 0)
+            TraceFormat format = a[3] != NULL && strcmp(a[3], "chrome") == 0 ? TRACE_CHROME : TRACE_JSONL;
+            if (trace_start(a[2], format) < 0)
             {
-                perror("dup2 input error");
-                exit(EXIT_FAILURE);
+                perror("trace");
+                return 1;
             }
-            close(in_fd); 
         }
+        else if (a[1] != NULL && strcmp(a[1], "flush") == 0 && a[2] == NULL)
+            trace_flush();
+        else if (a[1] != NULL && strcmp(a[1], "off") == 0 && a[2] == NULL)
+            trace_stop();
+        else if (a[1] == NULL)
+            printf("trace: %s\n", trace_enabled ? "on" : "off");
+        else
+        {
+            fprintf(stderr, "uso: trace [on ARQ [jsonl|chrome] | flush | off]\n");
+            return 1;
+        }
+        return 0;
+    }
 
-        // Redireciona a saida padrão se não for STDOUT_FILENO, so sai para padrao se for o ultimo comando
-        if (out_fd != STDOUT_FILENO)
+    for (int s = 0; s < stage_count; s++)
+    {
+        if (pipe_args[s][0] == NULL)
         {
-            if (dup2(out_fd, STDOUT_FILENO) < 0)
-            {
-                perror("dup2 output error");
-                exit(EXIT_FAILURE);
-            }
-            close(out_fd); // Fecha o descritor original
+            fprintf(stderr, "Erro: pipeline vazia\n");
+            pipe_is_valid = false;
+            continue;
         }
 
-        // Executa o comando e sai caso tenha erro
-        if (execvp(args[0], args) == -1)
+        if (!validate_command(pipe_args[s]))
         {
-            perror("Erro ao executar o comando");
-            exit(EXIT_FAILURE);
+            pipe_is_valid = false;
+            continue;
         }
     }
 
-    return pid; // Processo Pai retorna o PID do filho
-}
+    if (!pipe_is_valid)
+        return 1;
 
-// ! executa os comandos juntos chamando launch_process juntamente com pipes
-void execute_pipeline(char *stages[MAX_STAGES][MAX_ARGS + 1], int stage_count)
-{
-    int in_fd = STDIN_FILENO;
-    int fd[2];
-    pid_t pids[MAX_STAGES];
-    char *output_file = NULL;
-    int status;
-    int last_out_fd = STDOUT_FILENO;
-
-    for (int i = 0; i < stage_count; i++)
+    if (watching)
+        return run_watch(&watch, pipe_args, stage_count); // so volta com ctrl-c
+
+    if (stage_count > 1)
+    {
+        tail_inline = tail;
+        j = execute_pipeline(pipe_args, stage_count, STDOUT_FILENO);
+    }
+    else if (is_builtin(pipe_args[0][0]))
     {
-        int out_fd;
+        // builtin roda sem fork; o status sai direto, sem job
+        pid_t fanout;
+        int status = 1;
+        int fd = redirect_outputs(pipe_args[0], STDOUT_FILENO, &fanout);
+        if (fd < 0)
+            return 1;
 
-        // Se nao for o último comando, cria um pipe para a saida
-        if (i < stage_count - 1)
+        FILE *out = fd != STDOUT_FILENO ? fdopen(fd, "w") : stdout;
+        if (out == NULL)
         {
-            if (pipe(fd) == -1)
-            {
-                perror("pipe error");
-                exit(EXIT_FAILURE);
-            }
-            out_fd = fd[1]; // A saida sera a escrita do pipe
+            perror("erro ao abrir o aquivo");
+            close(fd);
         }
-        else // ultimo caso, escreve na saida padrao
+        else
         {
-            status = handle_output_file(stages[i], &output_file); 
-            if (status == -1)
-            {
-                fprintf(stderr, "erro de sintaxa abortando\n");
-                return;
-            }
-            
-            if (output_file != NULL)
-            {
-                out_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-
-                if (out_fd < 0)
-                {
-                    perror("error ao abrir pipe de saida");
-                    close(out_fd);
-                    return;
-                }
-            }else 
-            {
-                out_fd = STDOUT_FILENO;
-            }
+            status = run_builtin(pipe_args[0], out);
+            if (out != stdout)
+                fclose(out);
         }
-
-        // Lança o processo para o "comando atual"
-        pids[i] = launch_process(in_fd, out_fd, stages[i]);
-
-        // Fecha os "pipes de escrita" no processo pai
-        if (in_fd != STDIN_FILENO) close(in_fd);
-        
-        if (out_fd != STDOUT_FILENO) close(out_fd);
-
-        // A entrada para o proximo comando sera a leitura do pipe atual
-        if (i < stage_count - 1) in_fd = fd[0];
+        if (fanout > 0)
+            waitpid(fanout, NULL, 0);
+        return status;
+    }
+    else
+    {
+        j = execute(pipe_args[0]);
     }
 
-    for (int i = 0; i < stage_count; i++)
-        if (pids[i] > 0) waitpid(pids[i], NULL, 0);
+    if (j < 0)
+        return 1;
+    return wait ? wait_job(j) : 0;
 }
 
-// ! conta a quantidade de argumentos em cada comando
-int count_args(char **args)
+// ! run_pipeline sem deixar affinity/timeout da linha valendo para a proxima
+static int run_pipeline(char *pipe_args[MAX_STAGES][MAX_ARGS + 1], int stage_count, bool tail, bool wait)
 {
-    int count = 0;
-    if(args == NULL) return 0;
+    current_timeout = &session_timeout;
+    int status = launch_pipeline(pipe_args, stage_count, tail, wait);
+    current_place = &session_place;
+    current_timeout = &session_timeout;
+    return status;
+}
 
-    while (args[count] != NULL)
-    {
-        count++;
-    }
-    return count;
+// ! ScriptOps.run: uma pipeline do script; as palavras ja vem do argv
+// ! reaproveitado pela arvore, so os ponteiros sao separados em estagios
+static int script_run_words(char **words, bool background, void *ctx)
+{
+    char *pipe_args[MAX_STAGES][MAX_ARGS + 1];
+    (void)ctx;
+
+    int stage_count = split_pipeline_args(words, pipe_args);
+    int status = run_pipeline(pipe_args, stage_count, !background, !background);
+    if (!background)
+        free_line_allocs(); // $(...) da pipeline ja foram usados
+    return status;
 }
 
-// ! verifica se o comando e valido e se seus argumentos sao validos 
-bool validate_command(char **args)
+static char *script_capture(const char *cmd, void *ctx)
 {
+    (void)ctx;
+    return capture_output(cmd);
+}
 
-    char *command = args[0];
-    int num_args = count_args(args) - 1;
+// ! o ctrl-c visto pelo wait de um comando externo vale na hora; o loop de
+// ! eventos so e consultado a cada 1024 iteracoes para o laco de builtins
+// ! nao pagar um epoll_wait por volta
+static bool script_interrupted(void *ctx)
+{
+    static unsigned calls = 0;
+    (void)ctx;
+    return take_interrupt((++calls & 1023) == 0);
+}
 
-    if (strcmp(command, "cd") == 0)
-    {
-        if (num_args != 1)
-        {
-            fprintf(stderr, "uso: cd <dretorio>\n");
-            return false;
-        }
-        return 1;
-    }else if (strcmp(command, "ls") == 0)
-    {
-        return true;
-    }else if (strcmp(command, "pwd") == 0)
-    {
-        if (num_args != 0)
-        {
-            fprintf(stderr, "uso: pwd\n");
-            return false;
-        }
-        return true;
-    }else if (strcmp(command, "cat") == 0)
-    {
-        if (num_args < 1)
-        {
-            fprintf(stderr, "uso: cat <arquivo> [arquivo2 ...]\n");
-            return false;
-        }
-        return true;
-    }else
+// ! linha do corpo de um here-doc; o prompt de continuacao so aparece no
+// ! terminal, um corpo de milhoes de linhas vindo de arquivo nao paga o printf
+static int heredoc_line(char *buf, size_t size, void *ctx)
+{
+    static int tty = -1;
+    (void)ctx;
+    if (tty < 0)
+        tty = isatty(STDIN_FILENO);
+    if (tty)
     {
-        return true;
+        printf("> ");
+        fflush(stdout);
     }
+    return read_line(buf, size);
 }
 
-// ! aponta output_file para o arquivo apos > colocando em pipes
-int handle_output_file(char ** args, char **output_file)
+// ! funcao para debugar os args
+void print_args(char *row[])
 {
-    *output_file = NULL;
-
-    for (int i = 0; args[i] != NULL; i++)
+    if (row == NULL)
     {
-        if(strcmp(args[i], ">") == 0)
-        {
-            if (args[i+1] == NULL)
-            {
-                fprintf(stderr, "erro: falta nome do arquivo apos > \n");
-                return -1; // Indica a falha
-            }
-
-            *output_file = args[i+1];
-
-            args[i] = NULL;
+        printf("Erro: row é NULL\n");
+        return;
+    }
 
-            return 1;
-        }
+    for (int i = 0; row[i] != NULL; i++)
+    {
+        printf("%s", row[i]);
+        if (row[i + 1] != NULL)
+            printf(" "); // espaço entre argumentos
     }
-    
-    return 0; // Nao ha > nos argumentos
+    printf("\n");
 }
 
 //Lida com o comando path
-void fillPathsList(char* args[MAX_STAGES][MAX_ARGS],Lista*paths){
+void fillPathsList(char **args,Lista*paths){
     liberaLista(paths);
     for(int i = 1; i < count_args(args);i++){
-        printf("%s ",args[0][i]);
-        insert(paths,args[0][i]);
+        printf("%s ",args[i]);
+        insert(paths,args[i]);
     }
     printf("passou");
 }
@@ -457,7 +396,6 @@ Lista* insert(Lista* receba, char valor[]){
 
 //remover elemento da lista
 Lista* removeFrom(Lista* init){
-    Lista* novo;
     init = init->prox;
     return init;
 }
@@ -465,10 +403,10 @@ Lista* removeFrom(Lista* init){
 //liberar lista toda
 void liberaLista(Lista* list){
     Lista* aux = list;
-    Lista* prox;
     while(aux != NULL){
-        free(aux->prox);
+        Lista* prox = aux->prox;
         free(aux);
+        aux = prox;
     }
 }
 //verifica se a lista esta vazia
@@ -0,0 +1,227 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <time.h>
+#include "parser.h"
+#include "fileio.h"
+#include "textscan.h"
+#include "trace.h"
+#include "script.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+#define MAX_LINE 1024
+#define MAX_HEREDOCS 16 // here-docs numa linha
+#define HEREDOC_PIPE_MAX (64 * 1024) // corpo ate este tamanho vai por pipe, acima por memfd
+#define BUFFER_SIZE 256 // tamanho máximo da linha de entrada
+#define MAX_NODES 64    // número máximo de nós NUMA considerados
+#define MAX_JOBS 256    // número máximo de jobs vivos ao mesmo tempo
+#define MAX_EVENTS 16   // eventos tratados por volta do loop
+#define MAX_JOB_PROCS (4 * MAX_STAGES) // estagios mais relays do modo medido (pipes e "< arq") e fan-outs
+#define MAX_WATCH_PATHS 16       // caminhos "--on" de um watch
+#define WATCH_DEBOUNCE_MS 100    // rajada de eventos vira uma execucao so
+#define WATCH_PERIOD_MS 2000     // intervalo do watch sem --on
+#define MAX_OUTPUTS 8           // destinos "> arq" / ">> arq" por estagio
+#define RELAY_CHUNK (1 << 16)  // bytes pedidos por chamada de splice
+#define RELAY_REPORT_MS 1000   // intervalo do resumo parcial do modo medido
+#define CAPTURE_CHUNK (1 << 16) // espaco livre garantido antes de cada read da captura
+#define PATH_CACHE_SIZE 128     // comandos lembrados pelo cache de caminhos
+#define TIMEOUT_KILL_AFTER_MS 5000 // SIGTERM -> SIGKILL quando --kill-after nao e dado
+#define TIMEOUT_STATUS 124      // status de um job encerrado pelo timeout (como o timeout do coreutils)
+
+// politicas de posicionamento dos estagios nas cpus
+typedef enum
+{
+    PLACE_NONE,    // deixa o escalonador decidir
+    PLACE_COMPACT, // estagios em cores vizinhos que compartilham cache L2/L3
+    PLACE_SPREAD,  // pipelines sucessivas alternam entre os nos NUMA
+    PLACE_LIST     // lista explicita de cpus, uma por estagio
+} PlaceMode;
+
+typedef struct
+{
+    PlaceMode mode;
+    int cpus[CPU_SETSIZE]; // usada apenas em PLACE_LIST
+    int cpu_count;
+} Placement;
+
+// topologia lida do sysfs na inicializacao
+typedef struct
+{
+    int order[CPU_SETSIZE]; // cpus ordenadas por no, cache L3 e cache L2
+    int ncpus;
+    cpu_set_t nodes[MAX_NODES];
+    int nnodes;
+} Topology;
+
+// tipos de fd registrados no epoll, ficam nos 32 bits altos de data.u64
+enum
+{
+    EV_STDIN = 1,
+    EV_SIGNAL,
+    EV_PIDFD,
+    EV_TIMER,
+    EV_WATCH
+};
+
+// limite de tempo de uma pipeline; term_ms 0 = sem limite
+typedef struct
+{
+    long term_ms; // SIGTERM para o grupo depois disso
+    long kill_ms; // SIGKILL este tempo depois do SIGTERM, 0 = nunca
+} TimeoutSpec;
+
+// "watch [--on CAMINHO]... [--interval T]": com caminhos roda de novo quando
+// o inotify avisa, esperando T sem eventos; sem caminhos roda a cada T
+typedef struct
+{
+    const char *paths[MAX_WATCH_PATHS];
+    int count;
+    long interval_ms; // -1: padrao (WATCH_DEBOUNCE_MS ou WATCH_PERIOD_MS)
+} WatchSpec;
+
+// job: uma pipeline (ou comando simples) lancada a partir de uma linha
+typedef struct
+{
+    bool used;
+    bool foreground;    // a linha atual espera ele terminar
+    int alive;          // processos que ainda nao terminaram
+    pid_t pids[MAX_JOB_PROCS];
+    int pidfds[MAX_JOB_PROCS];
+    int count;
+    int last;           // indice do processo cujo status e o do job
+    int status;         // status do ultimo estagio
+    bool held;          // slot reservado ate o dono ler o resultado (daemon)
+    pid_t pgid;         // grupo proprio das pipelines com timeout, 0 = grupo da shell
+    uint64_t deadline;  // proximo passo do timeout (ns do CLOCK_MONOTONIC), 0 = nenhum
+    int timeout_phase;  // 0 rodando, 1 SIGTERM enviado, 2 SIGKILL enviado
+    TimeoutSpec timeout;
+    struct rusage usage; // soma do rusage dos processos ja coletados
+} Job;
+
+// cache comando -> caminho completo, esvaziado quando o PATH muda
+typedef struct
+{
+    char *names[PATH_CACHE_SIZE];
+    char *paths[PATH_CACHE_SIZE];
+    char *path_var; // PATH usado para preencher o cache
+} PathCache;
+
+// ambiente dos filhos lancados pelo nucleo; a libshell usa um por contexto
+typedef struct
+{
+    PathCache *cache; // NULL: execvp procura no PATH a cada exec
+    char **vars;      // "NOME=valor" exportados para os filhos, termina em NULL
+    const char *cwd;  // NULL: diretorio atual do processo
+    int err_fd;       // -1: stderr herdado
+    int in_fd;        // -1: stdin herdado pelo primeiro estagio
+    bool own_env;     // vars substitui o ambiente inteiro em vez de acrescentar
+} ExecEnv;
+
+// buffer que cresce dobrando de tamanho, usado na captura de $(...)
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+// corpo de here-doc ou here-string em montagem: ate HEREDOC_PIPE_MAX bytes
+// ficam no buf e viram um pipe; maior que isso vai para um memfd
+typedef struct
+{
+    char buf[HEREDOC_PIPE_MAX];
+    size_t len;
+    int memfd; // -1 enquanto o corpo cabe no buf
+} HereBody;
+
+typedef struct
+{
+    const char *word; // delimitador dentro da linha, o mesmo ponteiro que collect_input devolve
+    int fd;           // leitura do corpo, -1 depois que um estagio abriu
+} HereDoc;
+
+// le a proxima linha de corpo para buf: 1 leu, 0 fim da entrada, -1 ctrl-c
+typedef int (*HeredocReader)(char *buf, size_t size, void *ctx);
+
+int is_builtin(char *comand);
+int execute(char **args);
+int execute_pipeline(char *stages[MAX_STAGES][MAX_ARGS + 1], int stage_count, int out_fd);
+pid_t launch_process(int in_fd, int out_fd, char **args);
+int count_args(char **args);
+bool validate_command(char **args);
+void init_topology(void);
+int parse_cpu_list(const char *list, int *cpus, int max);
+int builtin_affinity(char **args, Placement *place);
+int builtin_timeout(char **args, TimeoutSpec *session, TimeoutSpec *line);
+int parse_watch(char **args, WatchSpec *spec);
+int run_watch(const WatchSpec *spec, char *stages[MAX_STAGES][MAX_ARGS + 1], int stage_count);
+void select_stage_cpus(int stage, int stage_count);
+void init_events(bool interactive);
+void pump_events(int timeout_ms);
+void reap_children(void);
+int job_start(pid_t *pids, int count, int last, bool foreground);
+pid_t start_relay(int link, int *in_fd);
+pid_t start_input_relay(int stage, int *in_fd);
+int strip_prefix(char **args);
+int expand_substitutions(char *stages[MAX_STAGES][MAX_ARGS + 1], int stage_count);
+int run_builtin(char **args, FILE *out);
+int wait_job(int j);
+void job_hold(int j, bool hold);
+bool job_result(int j, int *status, struct rusage *usage);
+void job_signal(int j, int sig);
+int events_fd(void);
+const char *path_cache_lookup(PathCache *cache, const char *cmd);
+void path_cache_clear(PathCache *cache);
+int open_output(const char *file, bool append);
+int open_input(const char *file);
+int read_heredocs(char *line, HeredocReader next, void *ctx);
+int redirect_outputs(char **args, int default_fd, pid_t *fanout);
+void buffer_reserve(Buffer *b, size_t extra);
+void buffer_append(Buffer *b, const char *data, size_t len);
+void free_line_allocs(void);
+void wait_foreground(void);
+bool take_interrupt(bool poll);
+char *capture_output(const char *cmd);
+int read_line(char *line, size_t size);
+int run_daemon(const char *sock_path);
+int run_command(const char *line, bool report);
+
+
+extern Placement session_place;
+extern Placement *current_place;
+extern TimeoutSpec session_timeout;
+extern TimeoutSpec *current_timeout;
+extern bool measure_session;
+extern bool measure_line;
+extern bool tail_inline;
+extern ExecEnv *exec_env;
+
+#endif
@@ -0,0 +1,430 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "textscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TS_X86 1
+#endif
+
+#define TS_OUT_SIZE 65536 // output is batched into writes of this size
+
+// ---- vector kernels ----
+
+static size_t count_byte_scalar(const char *buf, size_t len, char c) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) n += buf[i] == c;
+    return n;
+}
+
+#ifdef TS_X86
+// matches are accumulated per byte lane (at most 255 rounds) and then summed with psadbw
+__attribute__((target("avx2")))
+static size_t count_byte_avx2(const char *buf, size_t len, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t n = 0, i = 0;
+    while (len - i >= 32) {
+        size_t rounds = (len - i) / 32;
+        if (rounds > 255) rounds = 255;
+        __m256i acc = zero;
+        for (size_t r = 0; r < rounds; r++, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, needle));
+        }
+        __m256i sums = _mm256_sad_epu8(acc, zero);
+        n += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1)
+           + _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+    }
+    return n + count_byte_scalar(buf + i, len - i, c);
+}
+
+__attribute__((target("sse2")))
+static size_t count_byte_sse2(const char *buf, size_t len, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    const __m128i zero = _mm_setzero_si128();
+    size_t n = 0, i = 0;
+    while (len - i >= 16) {
+        size_t rounds = (len - i) / 16;
+        if (rounds > 255) rounds = 255;
+        __m128i acc = zero;
+        for (size_t r = 0; r < rounds; r++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, needle));
+        }
+        __m128i sums = _mm_sad_epu8(acc, zero);
+        n += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+    return n + count_byte_scalar(buf + i, len - i, c);
+}
+
+// candidates are positions where both the first and the last needle byte
+// match; only those are compared in full
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *hay, size_t len, const char *needle, size_t nlen) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[nlen - 1]);
+    size_t i = 0;
+    for (; i + nlen - 1 + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(hay + i + nlen - 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(hay + i + bit + 1, needle + 1, nlen - 2) == 0) return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return memmem(hay + i, len - i, needle, nlen);
+}
+
+__attribute__((target("sse2")))
+static const char *find_sse2(const char *hay, size_t len, const char *needle, size_t nlen) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[nlen - 1]);
+    size_t i = 0;
+    for (; i + nlen - 1 + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(hay + i + nlen - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(hay + i + bit + 1, needle + 1, nlen - 2) == 0) return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return memmem(hay + i, len - i, needle, nlen);
+}
+#endif
+
+// 2 = avx2, 1 = sse2, 0 = scalar; picked once from cpuid
+static int simd_level = -1;
+
+static int get_simd_level() {
+    if (simd_level < 0) {
+        simd_level = 0;
+#ifdef TS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) simd_level = 2;
+        else if (__builtin_cpu_supports("sse2")) simd_level = 1;
+#endif
+    }
+    return simd_level;
+}
+
+size_t ts_count_byte(const char *buf, size_t len, char c) {
+#ifdef TS_X86
+    int level = get_simd_level();
+    if (level == 2) return count_byte_avx2(buf, len, c);
+    if (level == 1) return count_byte_sse2(buf, len, c);
+#endif
+    return count_byte_scalar(buf, len, c);
+}
+
+const char *ts_find(const char *hay, size_t len, const char *needle, size_t nlen) {
+    if (nlen == 0) return hay;
+    if (nlen > len) return NULL;
+    // single bytes go to the libc memchr, which is already vectorized
+    if (nlen == 1) return memchr(hay, needle[0], len);
+#ifdef TS_X86
+    int level = get_simd_level();
+    if (level == 2) return find_avx2(hay, len, needle, nlen);
+    if (level == 1) return find_sse2(hay, len, needle, nlen);
+#endif
+    return memmem(hay, len, needle, nlen);
+}
+
+// ---- buffered output ----
+
+struct outbuf {
+    int fd;
+    char *data;
+    size_t len;
+    int failed; // a write failed (EPIPE when the reader went away)
+};
+
+static void out_flush(struct outbuf *ob) {
+    size_t done = 0;
+    while (done < ob->len && !ob->failed) {
+        ssize_t w = write(ob->fd, ob->data + done, ob->len - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) ob->failed = 1;
+        else done += w;
+    }
+    ob->len = 0;
+}
+
+static void out_write(struct outbuf *ob, const char *p, size_t n) {
+    if (ob->len + n > TS_OUT_SIZE) out_flush(ob);
+    if (n > TS_OUT_SIZE) {
+        // too big to batch: write straight from the input buffer
+        struct outbuf direct = {ob->fd, (char *)p, n, ob->failed};
+        out_flush(&direct);
+        ob->failed = direct.failed;
+        return;
+    }
+    memcpy(ob->data + ob->len, p, n);
+    ob->len += n;
+}
+
+// write the lines in [s, e), each prefixed with "label:"; the last line of
+// the input may lack its newline. Returns the number of lines.
+static long long emit_lines(struct outbuf *ob, const char *s, const char *e, const char *label, int quiet) {
+    long long lines = ts_count_byte(s, e - s, '\n') + (e > s && e[-1] != '\n');
+    if (quiet || s == e) return lines;
+    if (!label) {
+        out_write(ob, s, e - s);
+    } else {
+        size_t llen = strlen(label);
+        for (const char *p = s; p < e;) {
+            const char *nl = memchr(p, '\n', e - p);
+            const char *le = nl ? nl + 1 : e;
+            out_write(ob, label, llen);
+            out_write(ob, ":", 1);
+            out_write(ob, p, le - p);
+            p = le;
+        }
+    }
+    if (e[-1] != '\n') out_write(ob, "\n", 1);
+    return lines;
+}
+
+// ---- tools ----
+
+// grep -F over in_fd; only complete lines are scanned, the unfinished tail
+// waits in the buffer for the next read (the buffer grows for long lines)
+int ts_grep(int in_fd, int out_fd, const char *pattern, int invert, int count_only, const char *label) {
+    size_t plen = strlen(pattern);
+    size_t cap = TS_BUF_SIZE, have = 0;
+    char *buf = malloc(cap);
+    struct outbuf ob = {out_fd, malloc(TS_OUT_SIZE), 0, 0};
+    long long selected = 0;
+    int eof = 0, status = 0;
+
+    if (!buf || !ob.data) { free(buf); free(ob.data); return 2; }
+
+    while (!eof && !ob.failed) {
+        if (have == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) { status = 2; break; }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t r = read(in_fd, buf + have, cap - have);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            status = 2;
+            break;
+        }
+        if (r == 0) eof = 1;
+        have += r;
+
+        // at EOF an unterminated last line still counts
+        const char *end = eof ? buf + have : memrchr(buf, '\n', have);
+        if (!end) continue;
+        if (!eof) end++;
+
+        const char *p = buf;
+        while (p < end && !ob.failed) {
+            const char *m = ts_find(p, end - p, pattern, plen);
+            if (!m) {
+                if (invert) selected += emit_lines(&ob, p, end, label, count_only);
+                break;
+            }
+            const char *nl = memrchr(p, '\n', m - p);
+            const char *ls = nl ? nl + 1 : p;
+            const char *le = memchr(m, '\n', end - m);
+            le = le ? le + 1 : end;
+            if (invert) selected += emit_lines(&ob, p, ls, label, count_only);
+            else selected += emit_lines(&ob, ls, le, label, count_only);
+            p = le;
+        }
+
+        have -= end - buf;
+        memmove(buf, end, have);
+    }
+
+    if (count_only && !ob.failed) {
+        char line[64];
+        int n = snprintf(line, sizeof(line), "%lld\n", selected);
+        if (label) out_write(&ob, label, strlen(label)), out_write(&ob, ":", 1);
+        out_write(&ob, line, n);
+    }
+    out_flush(&ob);
+    free(buf);
+    free(ob.data);
+    if (status) return status;
+    return selected > 0 ? 0 : 1;
+}
+
+// count lines and bytes; regular files are mapped instead of copied
+int ts_wc(int in_fd, long long *lines, long long *bytes) {
+    struct stat st;
+    *lines = 0;
+    *bytes = 0;
+
+    off_t off = lseek(in_fd, 0, SEEK_CUR);
+    if (fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode) && off >= 0 && st.st_size > off) {
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, in_fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            *lines = ts_count_byte(map + off, st.st_size - off, '\n');
+            *bytes = st.st_size - off;
+            munmap(map, st.st_size);
+            lseek(in_fd, 0, SEEK_END);
+            return 0;
+        }
+    }
+
+    char *buf = malloc(TS_BUF_SIZE);
+    if (!buf) return 1;
+    while (1) {
+        ssize_t r = read(in_fd, buf, TS_BUF_SIZE);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) { free(buf); return 1; }
+        if (r == 0) break;
+        *lines += ts_count_byte(buf, r, '\n');
+        *bytes += r;
+    }
+    free(buf);
+    return 0;
+}
+
+// copy the first lines of in_fd to out_fd and stop reading right there, so
+// the caller can close in_fd and the writer gets SIGPIPE
+int ts_head(int in_fd, int out_fd, long long lines) {
+    char *buf = malloc(TS_BUF_SIZE);
+    if (!buf) return 1;
+
+    while (lines > 0) {
+        ssize_t r = read(in_fd, buf, TS_BUF_SIZE);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+
+        size_t take = r;
+        size_t found = ts_count_byte(buf, r, '\n');
+        if ((long long)found >= lines) {
+            const char *p = buf;
+            for (long long k = 0; k < lines; k++) p = memchr(p, '\n', buf + r - p) + 1;
+            take = p - buf;
+            lines = 0;
+        } else {
+            lines -= found;
+        }
+
+        struct outbuf ob = {out_fd, buf, take, 0};
+        out_flush(&ob);
+        if (ob.failed) break;
+    }
+    free(buf);
+    return 0;
+}
+
+// ---- argument handling shared by the shells ----
+
+enum { TS_GREP = 1, TS_WC, TS_HEAD };
+
+struct ts_call {
+    int tool;
+    const char *pattern;
+    int invert, count_only;     // grep
+    int want_lines, want_bytes; // wc
+    long long n;                // head
+};
+
+static int parse_count(const char *s, long long *n) {
+    if (!*s) return 0;
+    for (const char *p = s; *p; p++)
+        if (*p < '0' || *p > '9') return 0;
+    *n = atoll(s);
+    return 1;
+}
+
+// the accepted forms are the ones whose output matches the GNU tools:
+//   grep [-v] [-c] [-F] PATTERN   (PATTERN without regex characters unless -F)
+//   wc -l | wc -c | wc -lc
+//   head | head -n N | head -N
+// reading stdin; anything else is left to the external command
+static int ts_parse(char **args, struct ts_call *c) {
+    int i = 1;
+    memset(c, 0, sizeof(*c));
+    if (!args[0]) return 0;
+
+    if (strcmp(args[0], "grep") == 0) {
+        int fixed = 0;
+        c->tool = TS_GREP;
+        for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+            if (strcmp(args[i], "--") == 0) { i++; break; }
+            for (const char *f = args[i] + 1; *f; f++) {
+                if (*f == 'v') c->invert = 1;
+                else if (*f == 'c') c->count_only = 1;
+                else if (*f == 'F') fixed = 1;
+                else return 0;
+            }
+        }
+        if (!args[i] || args[i + 1]) return 0;
+        c->pattern = args[i];
+        return fixed || strpbrk(c->pattern, ".[]*^$\\") == NULL;
+    }
+
+    if (strcmp(args[0], "wc") == 0) {
+        c->tool = TS_WC;
+        for (; args[i]; i++) {
+            if (args[i][0] != '-' || !args[i][1]) return 0;
+            for (const char *f = args[i] + 1; *f; f++) {
+                if (*f == 'l') c->want_lines = 1;
+                else if (*f == 'c') c->want_bytes = 1;
+                else return 0;
+            }
+        }
+        return c->want_lines || c->want_bytes;
+    }
+
+    if (strcmp(args[0], "head") == 0) {
+        c->tool = TS_HEAD;
+        c->n = 10;
+        if (args[1] && strcmp(args[1], "-n") == 0) {
+            if (!args[2] || !parse_count(args[2], &c->n)) return 0;
+            i = 3;
+        } else if (args[1] && strncmp(args[1], "-n", 2) == 0) {
+            if (!parse_count(args[1] + 2, &c->n)) return 0;
+            i = 2;
+        } else if (args[1] && args[1][0] == '-') {
+            if (!parse_count(args[1] + 1, &c->n)) return 0;
+            i = 2;
+        }
+        return args[i] == NULL;
+    }
+    return 0;
+}
+
+int ts_handles(char **args) {
+    struct ts_call c;
+    return ts_parse(args, &c);
+}
+
+int ts_run(char **args, int in_fd, int out_fd) {
+    struct ts_call c;
+    if (!ts_parse(args, &c)) return 2;
+
+    if (c.tool == TS_GREP) return ts_grep(in_fd, out_fd, c.pattern, c.invert, c.count_only, NULL);
+    if (c.tool == TS_HEAD) return ts_head(in_fd, out_fd, c.n);
+
+    long long lines, bytes;
+    if (ts_wc(in_fd, &lines, &bytes) != 0) return 1;
+    char line[64];
+    int n;
+    if (c.want_lines && c.want_bytes) n = snprintf(line, sizeof(line), "%7lld %7lld\n", lines, bytes);
+    else n = snprintf(line, sizeof(line), "%lld\n", c.want_lines ? lines : bytes);
+    struct outbuf ob = {out_fd, line, n, 0};
+    out_flush(&ob);
+    return ob.failed;
+}
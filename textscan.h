@@ -0,0 +1,26 @@
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <stddef.h>
+
+#define TS_BUF_SIZE (1 << 18) // read size of the grep/wc/head loops
+
+// count occurrences of c in buf (AVX2 or SSE2 when available, scalar otherwise)
+size_t ts_count_byte(const char *buf, size_t len, char c);
+// first occurrence of needle in hay, NULL if none
+const char *ts_find(const char *hay, size_t len, const char *needle, size_t nlen);
+
+// the loops behind the grep/wc/head builtins; in_fd is read until EOF (head
+// stops early) and results go to out_fd. Return the exit status of the tool.
+// grep matches a fixed string; a non-NULL label prefixes each output line.
+int ts_grep(int in_fd, int out_fd, const char *pattern, int invert, int count_only, const char *label);
+int ts_wc(int in_fd, long long *lines, long long *bytes);
+int ts_head(int in_fd, int out_fd, long long lines);
+
+// 1 if args is a grep/wc/head call the loops above implement exactly (stdin
+// only, fixed-string pattern), so it can replace the external tool
+int ts_handles(char **args);
+// run a call accepted by ts_handles; returns the exit status
+int ts_run(char **args, int in_fd, int out_fd);
+
+#endif
@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include "trace.h"
+
+// um slot do anel; seq = indice + 1 depois que o escritor terminou de preencher
+typedef struct
+{
+    uint64_t seq;
+    uint64_t ts_ns;
+    const char *ev;
+    const char *ka;
+    const char *kb;
+    long a;
+    long b;
+    int pid;
+    char ph;
+    char name[TRACE_NAME_LEN];
+} TraceEvent;
+
+int trace_enabled = 0;
+
+static TraceEvent *ring = NULL;  // alocado so quando o trace liga
+static uint64_t head = 0;        // proximo indice livre, reservado com fetch_add
+static uint64_t flushed = 0;     // eventos ate aqui ja foram gravados
+static int trace_fd = -1;
+static TraceFormat trace_format = TRACE_JSONL;
+static int trace_pid = 0;
+static int exit_registered = 0;
+
+// ! grava um evento; sem lock: cada escritor reserva o slot com fetch_add e
+// ! publica com seq, entao sinais e threads do hospedeiro podem gravar juntos
+void trace_record(char ph, const char *ev, const char *name, const char *ka, long a, const char *kb, long b)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    uint64_t idx = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    TraceEvent *e = &ring[idx & (TRACE_RING_SIZE - 1)];
+
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    e->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    e->ev = ev;
+    e->ka = ka;
+    e->kb = kb;
+    e->a = a;
+    e->b = b;
+    e->pid = trace_pid;
+    e->ph = ph;
+    if (name == NULL)
+        name = "";
+    strncpy(e->name, name, TRACE_NAME_LEN - 1);
+    e->name[TRACE_NAME_LEN - 1] = '\0';
+    __atomic_store_n(&e->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+// ! copia s para out escapando para string JSON
+static size_t json_escape(char *out, size_t size, const char *s)
+{
+    size_t n = 0;
+    for (; *s != '\0' && n + 7 < size; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+        {
+            out[n++] = '\\';
+            out[n++] = c;
+        }
+        else if (c < 0x20)
+        {
+            n += snprintf(out + n, size - n, "\\u%04x", c);
+        }
+        else
+        {
+            out[n++] = c;
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+// ! formata um evento como uma linha JSONL ou um elemento do array do Chrome
+static int format_event(char *out, size_t size, const TraceEvent *e)
+{
+    char name[TRACE_NAME_LEN * 6 + 1];
+    char args[128] = "";
+    int n = 0;
+
+    json_escape(name, sizeof(name), e->name);
+    if (e->ka != NULL)
+        n += snprintf(args + n, sizeof(args) - n, ",\"%s\":%ld", e->ka, e->a);
+    if (e->kb != NULL)
+        n += snprintf(args + n, sizeof(args) - n, ",\"%s\":%ld", e->kb, e->b);
+
+    if (trace_format == TRACE_JSONL)
+        return snprintf(out, size, "{\"ts_ns\":%llu,\"pid\":%d,\"ph\":\"%c\",\"ev\":\"%s\",\"name\":\"%s\"%s}\n",
+                        (unsigned long long)e->ts_ns, e->pid, e->ph, e->ev, name, args);
+
+    // args sem a virgula inicial dentro do objeto "args"
+    return snprintf(out, size, "{\"name\":\"%s%s%s\",\"cat\":\"shell\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d%s,\"args\":{%s}},\n",
+                    e->ev, name[0] ? " " : "", name, e->ph, e->ts_ns / 1000.0, e->pid, e->pid,
+                    e->ph == 'i' ? ",\"s\":\"p\"" : "", args[0] ? args + 1 : "");
+}
+
+// ! grava os eventos novos; o anel sobrescreve os mais antigos se encher
+void trace_flush(void)
+{
+    if (ring == NULL || trace_fd < 0)
+        return;
+
+    char buf[1 << 16];
+    size_t len = 0;
+    uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint64_t start = flushed;
+    if (end - start > TRACE_RING_SIZE)
+        start = end - TRACE_RING_SIZE;
+
+    for (uint64_t i = start; i < end; i++)
+    {
+        TraceEvent *e = &ring[i & (TRACE_RING_SIZE - 1)];
+        if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != i + 1)
+            continue; // ainda sendo escrito ou ja sobrescrito
+
+        if (sizeof(buf) - len < 512)
+        {
+            // O_APPEND: varios processos gravam no mesmo arquivo sem misturar blocos
+            if (write(trace_fd, buf, len) < 0)
+                break;
+            len = 0;
+        }
+        len += format_event(buf + len, sizeof(buf) - len, e);
+    }
+    if (len > 0 && write(trace_fd, buf, len) < 0)
+        perror("trace");
+    flushed = end;
+}
+
+static void trace_atexit(void)
+{
+    if (trace_enabled)
+        trace_flush();
+}
+
+// ! liga o trace gravando em path; o formato do Chrome abre o array que os
+// ! processos vao preenchendo (o visualizador aceita o array sem o ']')
+int trace_start(const char *path, TraceFormat format)
+{
+    trace_stop();
+
+    if (ring == NULL)
+    {
+        ring = calloc(TRACE_RING_SIZE, sizeof(TraceEvent));
+        if (ring == NULL)
+            return -1;
+    }
+
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (trace_fd < 0)
+        return -1;
+    if (format == TRACE_CHROME && write(trace_fd, "[\n", 2) != 2)
+    {
+        close(trace_fd);
+        trace_fd = -1;
+        return -1;
+    }
+
+    if (!exit_registered)
+    {
+        atexit(trace_atexit);
+        exit_registered = 1;
+    }
+    trace_format = format;
+    trace_pid = getpid();
+    head = flushed = 0;
+    trace_enabled = 1;
+    return 0;
+}
+
+// ! grava o que falta e desliga
+void trace_stop(void)
+{
+    if (!trace_enabled)
+        return;
+    trace_flush();
+    trace_enabled = 0;
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+// ! chamado no filho logo depois do fork: o anel herdado e do pai, o filho
+// ! grava so os proprios eventos (um filho que chama exit grava na saida)
+void trace_child(void)
+{
+    if (!trace_enabled)
+        return;
+    trace_pid = getpid();
+    head = flushed = 0;
+}
+
+// ! SHELL_TRACE=arquivo ou SHELL_TRACE=arquivo,chrome
+void trace_from_env(void)
+{
+    const char *spec = getenv("SHELL_TRACE");
+    if (spec == NULL || spec[0] == '\0' || trace_enabled)
+        return;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s", spec);
+    TraceFormat format = TRACE_JSONL;
+    char *comma = strrchr(path, ',');
+    if (comma != NULL && strcmp(comma + 1, "chrome") == 0)
+    {
+        *comma = '\0';
+        format = TRACE_CHROME;
+    }
+    else if (comma != NULL && strcmp(comma + 1, "jsonl") == 0)
+    {
+        *comma = '\0';
+    }
+
+    // o ambiente passa para os filhos: so o primeiro processo trunca o arquivo
+    unsetenv("SHELL_TRACE");
+    if (trace_start(path, format) < 0)
+        perror("SHELL_TRACE");
+}
@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// trace de eventos (leitura de linha, parsing, pipe, fork, exec, wait) num
+// anel por processo, gravado em JSONL ou no formato do Chrome (about:tracing,
+// Perfetto) sob demanda ou na saida. Desligado custa um branch por ponto.
+// Liga com SHELL_TRACE=arquivo[,chrome] ou com o builtin trace da shell.
+
+#define TRACE_RING_SIZE 16384 // eventos guardados por processo (potencia de 2)
+#define TRACE_NAME_LEN 32     // bytes do nome copiados para o evento
+
+typedef enum
+{
+    TRACE_JSONL,
+    TRACE_CHROME
+} TraceFormat;
+
+extern int trace_enabled;
+
+// ph: 'B' inicio, 'E' fim, 'i' instantaneo; ev, ka e kb devem ser literais
+#define TRACE(ph, ev, name, ka, a, kb, b)                          \
+    do                                                             \
+    {                                                              \
+        if (__builtin_expect(trace_enabled, 0))                    \
+            trace_record(ph, ev, name, ka, (long)(a), kb, (long)(b)); \
+    } while (0)
+
+void trace_record(char ph, const char *ev, const char *name, const char *ka, long a, const char *kb, long b);
+int trace_start(const char *path, TraceFormat format);
+void trace_stop(void);
+void trace_flush(void);
+void trace_child(void);
+void trace_from_env(void);
+
+#endif